@@ -0,0 +1,242 @@
+#!/bin/sh
+# Benchmark the emulator with the GBN and SR protocols.
+#
+#   ./bench.sh [-n reps] [-o file] [-r rev] [-e]
+#                                     build both and run the scenario matrix
+#   ./bench.sh -c old.json new.json   compare two result files
+#
+# Both protocols are built from source into $BUILDDIR (default _bench)
+# with $CC $CFLAGS (default cc -O2), from the working tree or, with -r,
+# from a git revision.  Every scenario is run reps times (default 3)
+# with -B and the fastest run is kept.  The results are written as JSON,
+# one scenario per line, so two files from different commits can be
+# diffed directly or compared with -c, which prints the change in
+# ns/event and exits non zero if any scenario got slower by more than
+# $THRESHOLD percent (default 10).  It also prints the change in cache
+# misses per ACK where both files have them.
+#
+# -B reads the cache miss counters itself, but only in builds that have
+# it (user-044 on) and only where the machine exposes them.  -e counts
+# L1D load misses and last level cache load misses with perf stat
+# instead, for the whole process, so a revision from before the
+# counters can be measured too:
+#
+#   ./bench.sh -e -r <before> -o before.json
+#   ./bench.sh -e -o after.json
+#   ./bench.sh -c before.json after.json
+#
+# The arrival rate is one message every 100 time units: at higher rates
+# GBN's whole window resends, once a few timeouts happen, keep the FIFO
+# channel backed up and the run degenerates instead of measuring the
+# event loop.  Two scenarios are exceptions.  backlog lets GBN collapse
+# on purpose, for the cost of a long channel queue, which tolayer3()
+# walks for every packet; it runs the usual single channel, without -M.
+# window32 keeps a 32 packet window full, for the cost of ACK processing
+# in large windows, and needs the congestion window (-W) to keep GBN
+# from collapsing.
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+BUILDDIR=${BUILDDIR:-_bench}
+THRESHOLD=${THRESHOLD:-10}
+SRCS="emulator.c pktbuf.c checksum.c filexfer.c traffic.c profile.c checkpoint.c latency.c fec.c cwnd.c runner.c tune.c replicate.c cache.c multipath.c"
+PERFEVENTS="L1-dcache-load-misses,LLC-load-misses"
+# name messages loss corruption lambda options
+SCENARIOS="
+noloss   100000  0   0   100
+loss10   100000  0.1 0   100
+loss30   100000  0.3 0   100
+corrupt  100000  0   0.4 100
+million  1000000 0   0   100
+backlog  3000    0.1 0.1 10
+window32 100000  0.1 0   1   -x 32 -t 40 -W
+"
+
+compare() {
+  awk -v threshold="$THRESHOLD" '
+    function field(line, key,    s) {
+      s = line
+      if (!sub(".*\"" key "\": *\"?", "", s))
+        return ""
+      sub("[\",}].*", "", s)
+      return s
+    }
+    # the misses per ACK from perf stat (-e), or else from -B itself
+    function misses(line, name,    v) {
+      v = field(line, "perf_" name "_misses_per_ack")
+      if (v == "" || v == "null")
+        v = field(line, (name == "llc" ? "cache" : name) "_misses_per_ack")
+      return v == "null" ? "" : v
+    }
+    /"scenario"/ {
+      key = field($0, "protocol") "/" field($0, "scenario")
+      if (FNR == NR) {
+        keys[++nkeys] = key
+        old[key] = field($0, "ns_per_event")
+        oldl1d[key] = misses($0, "l1d")
+        oldllc[key] = misses($0, "llc")
+        next
+      }
+      newl1d[key] = misses($0, "l1d")
+      newllc[key] = misses($0, "llc")
+      new = field($0, "ns_per_event")
+      if (!(key in old)) {
+        printf "%-16s %12s %12.2f\n", key, "-", new
+        next
+      }
+      change = old[key] > 0 ? 100.0 * (new - old[key]) / old[key] : 0
+      printf "%-16s %12.2f %12.2f %+8.1f%%%s\n", key, old[key], new, change,
+             (change > threshold) ? "  SLOWER" : ""
+      if (change > threshold)
+        slower++
+    }
+    function misstable(title, o, n,    i, k, header) {
+      for (i = 1; i <= nkeys; i++) {
+        k = keys[i]
+        if (o[k] == "" || n[k] == "")
+          continue
+        if (!header++)
+          printf "\n%-16s %12s %12s %9s\n", title, "old", "new", "change"
+        printf "%-16s %12.2f %12.2f %+8.1f%%\n", k, o[k], n[k],
+               (o[k] > 0) ? 100.0 * (n[k] - o[k]) / o[k] : 0
+      }
+    }
+    BEGIN { printf "%-16s %12s %12s %9s\n", "ns/event", "old", "new", "change" }
+    END {
+      misstable("L1D misses/ACK", oldl1d, newl1d)
+      misstable("LLC misses/ACK", oldllc, newllc)
+      exit slower > 0
+    }
+  ' "$1" "$2"
+}
+
+# perfcounts perf-output acks: the perf stat counts as more fields of the
+# BENCH line, in total and per ACK
+perfcounts() {
+  awk -F, -v acks="$2" '
+    $3 == "L1-dcache-load-misses" { name = "perf_l1d_misses" }
+    $3 == "LLC-load-misses" { name = "perf_llc_misses" }
+    name != "" {
+      if ($1 ~ /^[0-9]+$/)
+        printf ", \"%s\": %s, \"%s_per_ack\": %.2f", name, $1, name, (acks > 0) ? $1 / acks : 0
+      else
+        printf ", \"%s\": null, \"%s_per_ack\": null", name, name
+      name = ""
+    }' "$1"
+}
+
+REPS=3
+OUT=
+REV=
+PERFSTAT=
+while getopts "n:o:r:ec" opt; do
+  case $opt in
+    n) REPS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    r) REV=$OPTARG ;;
+    e) PERFSTAT=1 ;;
+    c) COMPARE=1 ;;
+    *) echo "usage: $0 [-n reps] [-o file] [-r rev] [-e] | -c old.json new.json" >&2; exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ -n "$COMPARE" ]; then
+  if [ $# -ne 2 ]; then
+    echo "usage: $0 -c old.json new.json" >&2
+    exit 2
+  fi
+  compare "$1" "$2"
+  exit $?
+fi
+
+cd "$(dirname "$0")" || exit 1
+mkdir -p "$BUILDDIR" || exit 1
+if [ -n "$PERFSTAT" ] && ! perf stat -x, -e "$PERFEVENTS" -o /dev/null true 2>/dev/null; then
+  echo "$0: -e needs perf stat and the $PERFEVENTS events" >&2
+  exit 1
+fi
+SRCDIR=.
+if [ -n "$REV" ]; then
+  # the emulator is every source of the revision but the protocols and
+  # the other programs
+  SRCDIR=$BUILDDIR/src
+  rm -rf "$SRCDIR"
+  mkdir -p "$SRCDIR" || exit 1
+  git archive "$REV" | tar -x -C "$SRCDIR" || exit 1
+  SRCS=$(cd "$SRCDIR" && ls *.c | grep -v -x -e gbn.c -e sr.c -e udpnet.c -e cksumbench.c)
+fi
+# the result cache (-K) is keyed by the contents of every source
+srchash=$(cd "$SRCDIR" && cat $SRCS gbn.c sr.c *.h | cksum | cut -d' ' -f1)
+for p in gbn sr; do
+  echo "building $BUILDDIR/$p" >&2
+  files=
+  for f in $SRCS $p.c; do
+    files="$files $SRCDIR/$f"
+  done
+  $CC $CFLAGS -DSRCHASH="\"$srchash\"" -o "$BUILDDIR/$p" $files -lm || exit 1
+done
+
+if [ -n "$OUT" ]; then
+  exec > "$OUT"
+fi
+
+if [ -n "$REV" ]; then
+  commit=$(git rev-parse --short "$REV")
+else
+  commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+  if [ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+    commit="$commit-dirty"
+  fi
+fi
+echo "{"
+echo "  \"commit\": \"$commit\","
+echo "  \"cc\": \"$($CC --version 2>/dev/null | head -n 1)\","
+echo "  \"cflags\": \"$CFLAGS\","
+echo "  \"host\": \"$(uname -srm)\","
+echo "  \"reps\": $REPS,"
+echo "  \"perf_stat\": $([ -n "$PERFSTAT" ] && echo true || echo false),"
+echo "  \"results\": ["
+
+for p in gbn sr; do
+  echo "$SCENARIOS" | while read -r name msgs loss corrupt lambda opts; do
+    [ -z "$name" ] && continue
+    echo "running $p $name" >&2
+    if [ "$loss" = 0 ] && [ "$corrupt" = 0 ]; then
+      answers="$msgs\n$loss\n$corrupt\n$lambda\n0\n"
+    else
+      answers="$msgs\n$loss\n$corrupt\n2\n$lambda\n0\n"
+    fi
+    best=
+    bestns=
+    i=0
+    while [ $i -lt "$REPS" ]; do
+      if [ -n "$PERFSTAT" ]; then
+        output=$(printf "$answers" | perf stat -x, -e "$PERFEVENTS" -o "$BUILDDIR/perf.txt" "$BUILDDIR/$p" $opts -B)
+      else
+        output=$(printf "$answers" | "$BUILDDIR/$p" $opts -B)
+      fi
+      line=$(echo "$output" | sed -n 's/^BENCH {\(.*\)}$/\1/p')
+      if [ -z "$line" ]; then
+        echo "$p $name: no BENCH line" >&2
+        exit 1
+      fi
+      if [ -n "$PERFSTAT" ]; then
+        # from the report, as BENCH lines only count ACKs from user-044 on
+        acks=$(echo "$output" | sed -n 's/.*acknowledgements received at A: *\([0-9]*\).*/\1/p')
+        line="$line$(perfcounts "$BUILDDIR/perf.txt" "$acks")"
+      fi
+      ns=$(echo "$line" | sed 's/.*"wall_ns": \([0-9]*\).*/\1/')
+      if [ -z "$bestns" ] || [ "$ns" -lt "$bestns" ]; then
+        best=$line
+        bestns=$ns
+      fi
+      i=$((i + 1))
+    done
+    printf '    {"protocol": "%s", "scenario": "%s", "messages": %s, "loss": %s, "corruption": %s, "lambda": %s, "options": "%s", %s}\n' \
+           "$p" "$name" "$msgs" "$loss" "$corrupt" "$lambda" "$opts" "$best"
+  done
+done | sed '$!s/$/,/'
+
+echo "  ]"
+echo "}"
@@ -0,0 +1,140 @@
+/* ******************************************************************
+   RESULT CACHE
+
+   Lets sweeps and replications skip the points they have run before.
+   - the key is the description given by run_describe(), hashed with
+   64 bit FNV-1a for the file name; the description itself is the first
+   line of the file and is compared on lookup, so a hash collision is a
+   miss and not a wrong answer
+   - the result follows as one line of numbers printed with full
+   precision, so a cached result is bit for bit the simulated one
+   - entries are written to a temporary file and renamed into place, so
+   parallel runs sharing a directory never see half an entry
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "runner.h"
+#include "cache.h"
+
+#define CACHE_KEYLEN 1024
+
+static char dir[4096];
+static int hits, misses, stored;
+
+void cache_open(const char *path)
+{
+  if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "cache: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  snprintf(dir, sizeof(dir), "%s", path);
+}
+
+int cache_active(void)
+{
+  return dir[0] != '\0';
+}
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+
+static unsigned long long fnv1a(unsigned long long h, const unsigned char *p, size_t n)
+{
+  while (n-- > 0) {
+    h ^= *p++;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+const char *cache_version(void)
+{
+#ifdef SRCHASH
+  return SRCHASH;
+#else
+  static char version[32];
+  unsigned char buf[65536];
+  unsigned long long h = FNV_BASIS;
+  FILE *fp;
+  size_t n;
+
+  if (version[0] != '\0')
+    return version;
+  fp = fopen("/proc/self/exe", "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "cache: cannot read the executable for its version, build with -DSRCHASH\n");
+    exit(EXIT_FAILURE);
+  }
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    h = fnv1a(h, buf, n);
+  fclose(fp);
+  snprintf(version, sizeof(version), "exe %016llx", h);
+  return version;
+#endif
+}
+
+/* description and file name of a point */
+static void locate(const struct runcfg *cfg, char *key, char *path, size_t size)
+{
+  run_describe(cfg, key, CACHE_KEYLEN);
+  snprintf(path, size, "%s/%016llx", dir, fnv1a(FNV_BASIS, (const unsigned char *)key, strlen(key)));
+}
+
+int cache_get(const struct runcfg *cfg, struct runresult *res)
+{
+  char key[CACHE_KEYLEN], line[CACHE_KEYLEN + 2], path[4200];
+  FILE *fp;
+  int n;
+
+  locate(cfg, key, path, sizeof(path));
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    misses++;
+    return 0;
+  }
+  n = 0;
+  if (fgets(line, sizeof(line), fp) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, key) == 0)
+      n = fscanf(fp, "%d %lg %ld %lg %lg %lg %d %d %d %d", &res->ok, &res->simtime, &res->bytes,
+                 &res->goodput, &res->mean, &res->p99, &res->delivered, &res->resent,
+                 &res->refused, &res->acks);
+  }
+  fclose(fp);
+  if (n != 10) {
+    misses++;
+    return 0;
+  }
+  hits++;
+  return 1;
+}
+
+void cache_put(const struct runcfg *cfg, const struct runresult *res)
+{
+  char key[CACHE_KEYLEN], path[4200], tmp[4300];
+  FILE *fp;
+
+  locate(cfg, key, path, sizeof(path));
+  snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+  fp = fopen(tmp, "w");
+  if (fp == NULL)
+    return;                         /* a cache that cannot be written is only slower */
+  fprintf(fp, "%s\n%d %.17g %ld %.17g %.17g %.17g %d %d %d %d\n", key, res->ok, res->simtime,
+          res->bytes, res->goodput, res->mean, res->p99, res->delivered, res->resent,
+          res->refused, res->acks);
+  if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+    remove(tmp);
+    return;
+  }
+  stored++;
+}
+
+void cache_report(void)
+{
+  if (!cache_active())
+    return;
+  printf("result cache %s:  %d hits, %d misses (%d results stored) \n", dir, hits, misses, stored);
+}
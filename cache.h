@@ -0,0 +1,31 @@
+/* result cache (-K dir): the results of replicas (runner.c) are kept   */
+/* on disk, one file per simulation point, named after an FNV-1a hash   */
+/* of a description of everything that decides the result: protocol    */
+/* and emulator source version, channel, options, length and seed.  A   */
+/* simulation is deterministic given these, so a point that has been    */
+/* run before is read back instead of simulated again.                  */
+/*                                                                      */
+/* The source version is SRCHASH if the build defines it, e.g.          */
+/*   cc -DSRCHASH="\"$(cat *.c *.h | cksum | cut -d' ' -f1)\"" ...       */
+/* as bench.sh does, and otherwise a hash of the running executable, so  */
+/* a change to any source linked in starts a new cache while a rebuild  */
+/* of the same sources keeps it.  An arrival trace (-a trace:file) is   */
+/* part of the key by the hash of its contents, not its name.           */
+
+/* use the cache in this directory, creating it if needed */
+extern void cache_open(const char *);
+
+/* non zero when a cache directory has been given */
+extern int cache_active(void);
+
+/* fill in the result of a replica if it is in the cache; returns 0 if not */
+extern int cache_get(const struct runcfg *, struct runresult *);
+
+/* store the result of a replica */
+extern void cache_put(const struct runcfg *, const struct runresult *);
+
+/* print the number of hits and misses */
+extern void cache_report(void);
+
+/* the source version, for the key (run_describe()) */
+extern const char *cache_version(void);
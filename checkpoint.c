@@ -0,0 +1,245 @@
+/* ******************************************************************
+   CHECKPOINTS
+
+   Binary snapshots of a whole simulation, so a long run can be stopped
+   and resumed, or several runs can branch off one warm-up.
+   - there is no separate save and restore code: every module hands its
+   variables to ckpt_data() in a fixed order, which writes them out or
+   reads them back in place depending on how the checkpoint was opened
+   - packets are shared between the event list, the sender's window and
+   the receiver's buffer.  Each packet is stored the first time it is
+   seen, later references only store its number, so after a restore the
+   same packets are shared and have the same reference counts
+   - a CRC-32C of the contents follows them, and a checkpoint is written
+   to a temporary file that is renamed over the old one once complete,
+   so an interrupted save never leaves a damaged checkpoint behind
+   ********************************************************************* */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "emulator.h"
+#include "checksum.h"
+#include "checkpoint.h"
+
+#define CKPT_MAGIC   "GBNSIMCK"
+#define CKPT_VERSION 4
+#define CKPT_BUFSIZE (1 << 20)
+
+static FILE *fp;
+static int restoring;
+static char path[4096], tmppath[4096 + 8];
+static unsigned int crc;            /* running CRC-32C of the contents */
+static char *iobuf;
+
+/* packets seen so far: on save a hash from pointer to number, on */
+/* restore the table from number to pointer                       */
+static struct pkt **pkts;
+static int *pktids;
+static int npkts, maxpkts;
+
+static void fail(const char *what)
+{
+  fprintf(stderr, "checkpoint %s: %s%s%s\n", path, what,
+          errno ? ": " : "", errno ? strerror(errno) : "");
+  exit(EXIT_FAILURE);
+}
+
+static void rawdata(void *p, size_t size)
+{
+  if (restoring) {
+    if (fread(p, 1, size, fp) != size) {
+      if (!ferror(fp))
+        errno = 0;
+      fail(ferror(fp) ? "read failed" : "file is truncated");
+    }
+  }
+  else if (fwrite(p, 1, size, fp) != size)
+    fail("write failed");
+}
+
+void ckpt_data(void *p, size_t size)
+{
+  rawdata(p, size);
+  crc = crc32c_update(crc, p, size);
+}
+
+void ckpt_begin(const char *name, int saving)
+{
+  char magic[8];
+  int version, maxpayload;
+
+  snprintf(path, sizeof(path), "%s", name);
+  restoring = !saving;
+  if (saving) {
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+    fp = fopen(tmppath, "wb");
+  }
+  else
+    fp = fopen(path, "rb");
+  if (fp == NULL)
+    fail("cannot open");
+  if (iobuf == NULL && (iobuf = malloc(CKPT_BUFSIZE)) == NULL) {
+    printf("memory allocation for checkpoint buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  setvbuf(fp, iobuf, _IOFBF, CKPT_BUFSIZE);
+  crc = 0xffffffff;
+  npkts = 0;
+  if (pkts != NULL)
+    memset(pkts, 0, maxpkts * sizeof(struct pkt *));
+
+  memcpy(magic, CKPT_MAGIC, 8);
+  version = CKPT_VERSION;
+  maxpayload = MAXPAYLOAD;
+  ckpt_data(magic, 8);
+  CKPT(version);
+  CKPT(maxpayload);
+  errno = 0;
+  if (memcmp(magic, CKPT_MAGIC, 8) != 0)
+    fail("not a checkpoint file");
+  if (version != CKPT_VERSION || maxpayload != MAXPAYLOAD)
+    fail("written by an incompatible version of the emulator");
+}
+
+void ckpt_end(void)
+{
+  unsigned int sum, stored;
+
+  sum = ~crc;
+  stored = sum;
+  rawdata(&stored, sizeof(stored));
+  if (restoring) {
+    fclose(fp);
+    errno = 0;
+    if (stored != sum)
+      fail("CRC mismatch, the file is damaged");
+  }
+  else {
+    if (fflush(fp) != 0 || fclose(fp) != 0)
+      fail("write failed");
+    if (rename(tmppath, path) != 0)
+      fail("cannot rename the new checkpoint into place");
+  }
+  fp = NULL;
+}
+
+int ckpt_restoring(void)
+{
+  return restoring;
+}
+
+void ckpt_string(char *s, size_t size)
+{
+  int len;
+
+  len = restoring ? 0 : (int)strlen(s);
+  CKPT(len);
+  if (len < 0 || (size_t)len >= size) {
+    errno = 0;
+    fail("string too long");
+  }
+  ckpt_data(s, len);
+  s[len] = '\0';
+}
+
+void ckpt_tag(const char *tag)
+{
+  char s[64];
+
+  snprintf(s, sizeof(s), "%s", tag);
+  ckpt_string(s, sizeof(s));
+  if (strcmp(s, tag) != 0) {
+    errno = 0;
+    fprintf(stderr, "checkpoint %s: expected section '%s', found '%s'\n", path, tag, s);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* grow the packet tables; on save the pointer hash is rebuilt */
+static void growpkts(void)
+{
+  struct pkt **oldpkts = pkts;
+  int *oldids = pktids;
+  int oldmax = maxpkts, i, h;
+
+  maxpkts = maxpkts ? 2 * maxpkts : 1024;
+  pkts = calloc(maxpkts, sizeof(struct pkt *));
+  pktids = calloc(maxpkts, sizeof(int));
+  if (pkts == 0 || pktids == 0) {
+    printf("memory allocation for checkpoint failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<oldmax; i++) {
+    if (restoring)
+      pkts[i] = oldpkts[i];
+    else if (oldpkts[i] != NULL) {
+      h = (int)(((size_t)oldpkts[i] >> 4) & (maxpkts - 1));
+      while (pkts[h] != NULL)
+        h = (h + 1) & (maxpkts - 1);
+      pkts[h] = oldpkts[i];
+      pktids[h] = oldids[i];
+    }
+  }
+  free(oldpkts);
+  free(oldids);
+}
+
+/* the header and the used part of the payload */
+static void pktcontents(struct pkt *p)
+{
+  CKPT(p->seqnum);
+  CKPT(p->acknum);
+  CKPT(p->checksum);
+  CKPT(p->length);
+  CKPT(*pktsends(p));
+  if (p->length < 0 || p->length > MAXPAYLOAD) {
+    errno = 0;
+    fail("packet length out of range");
+  }
+  ckpt_data(p->payload, p->length);
+}
+
+void ckpt_pkt(struct pkt **pp)
+{
+  int id, h;
+
+  if (restoring) {
+    CKPT(id);
+    if (id < 0)
+      *pp = NULL;
+    else if (id < npkts)
+      *pp = holdpkt(pkts[id]);
+    else if (id == npkts) {
+      if (npkts == maxpkts)
+        growpkts();
+      *pp = pkts[npkts++] = allocpkt();
+      pktcontents(*pp);
+    }
+    else {
+      errno = 0;
+      fail("bad packet reference");
+    }
+    return;
+  }
+
+  if (*pp == NULL) {
+    id = -1;
+    CKPT(id);
+    return;
+  }
+  if (2 * (npkts + 1) > maxpkts)
+    growpkts();
+  h = (int)(((size_t)*pp >> 4) & (maxpkts - 1));
+  while (pkts[h] != NULL && pkts[h] != *pp)
+    h = (h + 1) & (maxpkts - 1);
+  if (pkts[h] != NULL) {
+    CKPT(pktids[h]);                /* stored already */
+    return;
+  }
+  pkts[h] = *pp;
+  pktids[h] = id = npkts++;
+  CKPT(id);
+  pktcontents(*pp);
+}
@@ -0,0 +1,31 @@
+/* checkpoint files: the complete state of a simulation, written by the */
+/* emulator every -i time units to the file given with -C and read back */
+/* with -R.  Each module that keeps state has one function that passes  */
+/* every variable to ckpt_data() / ckpt_pkt(); the same function saves  */
+/* the state or restores it, depending on which way the file is open.   */
+
+/* open a checkpoint for writing (saving non zero) or reading */
+extern void ckpt_begin(const char *, int);
+
+/* finish: a saved checkpoint is renamed into place, a restored one has */
+/* its CRC-32C checked                                                  */
+extern void ckpt_end(void);
+
+/* non zero while a checkpoint is being read */
+extern int ckpt_restoring(void);
+
+/* save or restore size bytes at the address */
+extern void ckpt_data(void *, size_t);
+#define CKPT(x) ckpt_data(&(x), sizeof(x))
+
+/* save or restore a NUL terminated string in a buffer of the given size */
+extern void ckpt_string(char *, size_t);
+
+/* save or restore a section name; restoring stops with an error if the */
+/* file does not have the same section at this point                   */
+extern void ckpt_tag(const char *);
+
+/* save or restore a packet reference (may be NULL).  A packet referred */
+/* to from several places is stored once and comes back as one packet  */
+/* holding the same number of references.                              */
+extern void ckpt_pkt(struct pkt **);
@@ -0,0 +1,374 @@
+/* ******************************************************************
+   CHECKSUM ENGINES
+
+   Implementations of the packet checksums selectable with -k:
+   - sum:    the original additive sum, kept for comparison.  It misses
+   swapped bytes and any pair of changes that cancel out.
+   - inet:   the 16 bit ones' complement Internet checksum.  Scalar
+   version adds 32 bit words into a 64 bit accumulator; the SSE2 and
+   AVX2 versions widen 32 bit lanes into 64 bit lanes, so no carries are
+   lost, and fold once at the end.
+   - crc32c: CRC-32C.  Uses the SSE4.2 crc32 instruction 8 bytes at a
+   time when available, otherwise a slicing-by-8 table.
+
+   The SIMD versions are compiled with per function target attributes
+   and only called after the CPU has been checked, so the file needs no
+   special compiler flags.  The wide inet loops only pay off on long
+   buffers: a 20 byte payload never enters them, and cksumbench shows
+   the scalar version ahead up to a few hundred bytes.  So each
+   implementation has a shortest length it is used for, and shorter
+   buffers go to the next one of the same algorithm.
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "emulator.h"
+#include "checksum.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+const char *cksum_names[] = { "sum", "inet", "crc32c" };
+
+static int always(void)
+{
+  return 1;
+}
+
+/********************* sum **************************/
+
+static unsigned int sum_scalar(unsigned int state, const unsigned char *p, size_t n)
+{
+  int sum = (int)state;
+  size_t i;
+
+  for (i=0; i<n; i++)
+    sum += (int)(char)p[i];
+  return (unsigned int)sum;
+}
+
+/********************* inet *************************/
+
+/* fold a 64 bit ones' complement accumulator down to 16 bits */
+static unsigned int fold16(uint64_t s)
+{
+  s = (s & 0xffffffff) + (s >> 32);
+  s = (s & 0xffffffff) + (s >> 32);
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  return (unsigned int)s;
+}
+
+/* add the bytes that are left over after the wide loops */
+static uint64_t inet_tail(uint64_t s, const unsigned char *p, size_t n)
+{
+  uint32_t w;
+  uint16_t h;
+
+  while (n >= 4) {
+    memcpy(&w, p, 4);
+    s += w;
+    p += 4;
+    n -= 4;
+  }
+  if (n >= 2) {
+    memcpy(&h, p, 2);
+    s += h;
+    p += 2;
+    n -= 2;
+  }
+  if (n) {
+    h = 0;                      /* odd byte, padded with a zero byte */
+    memcpy(&h, p, 1);
+    s += h;
+  }
+  return s;
+}
+
+static unsigned int inet_scalar(unsigned int state, const unsigned char *p, size_t n)
+{
+  uint64_t s = state;
+  uint32_t w[4];
+
+  while (n >= 16) {
+    memcpy(w, p, 16);
+    s += (uint64_t)w[0] + w[1] + w[2] + w[3];
+    p += 16;
+    n -= 16;
+  }
+  return fold16(inet_tail(s, p, n));
+}
+
+#ifdef CKSUM_X86
+static int have_sse2(void)
+{
+  return __builtin_cpu_supports("sse2");
+}
+
+static int have_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+static int have_sse42(void)
+{
+  return __builtin_cpu_supports("sse4.2");
+}
+
+__attribute__((target("sse2")))
+static unsigned int inet_sse2(unsigned int state, const unsigned char *p, size_t n)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = _mm_setzero_si128();
+  __m128i acc1 = _mm_setzero_si128();
+  __m128i v;
+  uint64_t lanes[2];
+  uint64_t s;
+
+  while (n >= 32) {
+    v = _mm_loadu_si128((const __m128i *)p);
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+    v = _mm_loadu_si128((const __m128i *)(p + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+    p += 32;
+    n -= 32;
+  }
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+  s = (uint64_t)state + fold16(lanes[0]) + fold16(lanes[1]);
+  return fold16(inet_tail(s, p, n));
+}
+
+__attribute__((target("avx2")))
+static unsigned int inet_avx2(unsigned int state, const unsigned char *p, size_t n)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  __m256i v;
+  uint64_t lanes[4];
+  uint64_t s;
+
+  while (n >= 64) {
+    v = _mm256_loadu_si256((const __m256i *)p);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    v = _mm256_loadu_si256((const __m256i *)(p + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    p += 64;
+    n -= 64;
+  }
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+  s = (uint64_t)state + fold16(lanes[0]) + fold16(lanes[1])
+    + fold16(lanes[2]) + fold16(lanes[3]);
+  return fold16(inet_tail(s, p, n));
+}
+#endif
+
+/********************* crc32c ***********************/
+
+#define CRC32C_POLY 0x82f63b78      /* reflected Castagnoli polynomial */
+
+static uint32_t crctable[8][256];
+static int crctableready = 0;
+
+static void crc32c_maketable(void)
+{
+  uint32_t c;
+  int i, j;
+
+  for (i=0; i<256; i++) {
+    c = i;
+    for (j=0; j<8; j++)
+      c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    crctable[0][i] = c;
+  }
+  for (i=0; i<256; i++)
+    for (j=1; j<8; j++)
+      crctable[j][i] = (crctable[j-1][i] >> 8) ^ crctable[0][crctable[j-1][i] & 0xff];
+  crctableready = 1;
+}
+
+/* slicing-by-8: one table lookup per byte, eight independent lookups */
+/* per 8 byte step.  Assumes a little endian host for the wide step.   */
+static unsigned int crc32c_scalar(unsigned int state, const unsigned char *p, size_t n)
+{
+  uint32_t c = state;
+  uint32_t lo, hi;
+
+  if (!crctableready)
+    crc32c_maketable();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (n >= 8) {
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= c;
+    c = crctable[7][lo & 0xff] ^ crctable[6][(lo >> 8) & 0xff] ^
+        crctable[5][(lo >> 16) & 0xff] ^ crctable[4][lo >> 24] ^
+        crctable[3][hi & 0xff] ^ crctable[2][(hi >> 8) & 0xff] ^
+        crctable[1][(hi >> 16) & 0xff] ^ crctable[0][hi >> 24];
+    p += 8;
+    n -= 8;
+  }
+#else
+  (void)lo;
+  (void)hi;
+#endif
+  while (n--)
+    c = (c >> 8) ^ crctable[0][(c ^ *p++) & 0xff];
+  return c;
+}
+
+#ifdef CKSUM_X86
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42(unsigned int state, const unsigned char *p, size_t n)
+{
+#ifdef __x86_64__
+  uint64_t c = state;
+  uint64_t w;
+
+  while (n >= 8) {
+    memcpy(&w, p, 8);
+    c = _mm_crc32_u64(c, w);
+    p += 8;
+    n -= 8;
+  }
+#else
+  uint32_t c = state;
+  uint32_t w;
+
+  while (n >= 4) {
+    memcpy(&w, p, 4);
+    c = _mm_crc32_u32(c, w);
+    p += 4;
+    n -= 4;
+  }
+#endif
+  while (n--)
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+  return (unsigned int)c;
+}
+#endif
+
+/********************* selection ********************/
+
+/* fastest on long buffers first within each algorithm, each ending */
+/* with a scalar version for any length                              */
+const struct cksum_impl cksum_impls[] = {
+  { CKSUM_SUM,    "scalar", always,     sum_scalar,    0 },
+#ifdef CKSUM_X86
+  { CKSUM_INET,   "avx2",   have_avx2,  inet_avx2,     256 },
+  { CKSUM_INET,   "sse2",   have_sse2,  inet_sse2,     256 },
+#endif
+  { CKSUM_INET,   "scalar", always,     inet_scalar,   0 },
+#ifdef CKSUM_X86
+  { CKSUM_CRC32C, "sse4.2", have_sse42, crc32c_sse42,  0 },
+#endif
+  { CKSUM_CRC32C, "scalar", always,     crc32c_scalar, 0 }
+};
+const int ncksum_impls = sizeof(cksum_impls) / sizeof(cksum_impls[0]);
+
+/* the usable implementations of the selected algorithm, longest */
+/* minbytes first, down to one for any length                    */
+static const struct cksum_impl *engine[4];
+static int algorithm = -1;
+static char engine_name[64];
+
+/* continue a checksum with the implementation for n bytes */
+static unsigned int engine_update(unsigned int state, const unsigned char *p, size_t n)
+{
+  const struct cksum_impl **e = engine;
+
+  while ((*e)->minbytes > n)
+    e++;
+  return (*e)->update(state, p, n);
+}
+
+int cksum_select(const char *name)
+{
+  int alg, i, n;
+  size_t used;
+
+  for (alg=0; alg<3; alg++)
+    if (strcmp(name, cksum_names[alg]) == 0)
+      break;
+  if (alg == 3)
+    return -1;
+  /* skip those that a faster one already covers from the same length */
+  n = 0;
+  engine_name[0] = '\0';
+  for (i=0; i<ncksum_impls && (n == 0 || engine[n-1]->minbytes > 0); i++)
+    if (cksum_impls[i].algorithm == alg && cksum_impls[i].usable() &&
+        (n == 0 || cksum_impls[i].minbytes < engine[n-1]->minbytes)) {
+      engine[n++] = &cksum_impls[i];
+      used = strlen(engine_name);
+      if (cksum_impls[i].minbytes > 0)
+        snprintf(engine_name + used, sizeof(engine_name) - used, "%s from %lu bytes, ",
+                 cksum_impls[i].name, (unsigned long)cksum_impls[i].minbytes);
+      else
+        snprintf(engine_name + used, sizeof(engine_name) - used, "%s", cksum_impls[i].name);
+    }
+  if (n == 0 || engine[n-1]->minbytes > 0)
+    return -1;
+  algorithm = alg;
+  return 0;
+}
+
+const char *cksum_algorithm(void)
+{
+  if (algorithm < 0)
+    cksum_select("crc32c");
+  return cksum_names[algorithm];
+}
+
+const char *cksum_implementation(void)
+{
+  if (algorithm < 0)
+    cksum_select("crc32c");
+  return engine_name;
+}
+
+int cksum_packet(struct pkt *packet)
+{
+  int hdr[3];
+  unsigned int s;
+
+  if (algorithm < 0)
+    cksum_select("crc32c");
+  switch (algorithm) {
+  case CKSUM_SUM:
+    s = packet->seqnum + packet->acknum + packet->length;
+    return (int)engine_update(s, (unsigned char *)packet->payload, packet->length);
+  case CKSUM_INET:
+    hdr[0] = packet->seqnum;
+    hdr[1] = packet->acknum;
+    hdr[2] = packet->length;
+    s = engine_update(0, (unsigned char *)hdr, sizeof(hdr));
+    s = engine_update(s, (unsigned char *)packet->payload, packet->length);
+    return (int)(~s & 0xffff);
+  default:
+    hdr[0] = packet->seqnum;
+    hdr[1] = packet->acknum;
+    hdr[2] = packet->length;
+    s = engine_update(0xffffffff, (unsigned char *)hdr, sizeof(hdr));
+    s = engine_update(s, (unsigned char *)packet->payload, packet->length);
+    return (int)~s;
+  }
+}
+
+unsigned int crc32c_update(unsigned int state, const unsigned char *p, size_t n)
+{
+  static const struct cksum_impl *crc = NULL;
+  int i;
+
+  if (crc == NULL)
+    for (i=0; i<ncksum_impls && crc == NULL; i++)
+      if (cksum_impls[i].algorithm == CKSUM_CRC32C && cksum_impls[i].usable())
+        crc = &cksum_impls[i];
+  return crc->update(state, p, n);
+}
@@ -0,0 +1,41 @@
+/* checksum engines used by ComputeChecksum() in the protocols.  The     */
+/* algorithm is chosen by name; of the implementations of it that the   */
+/* CPU supports, the fastest for the length is picked on every call.    */
+/*   "sum"    - the original additive sum of the header and payload     */
+/*   "inet"   - 16 bit ones' complement Internet checksum (RFC 1071)    */
+/*   "crc32c" - CRC-32C (Castagnoli), the default                       */
+
+#include <stddef.h>
+
+#define CKSUM_SUM      0
+#define CKSUM_INET     1
+#define CKSUM_CRC32C   2
+
+/* select the algorithm by name, returns -1 if the name is unknown */
+extern int cksum_select(const char *);
+
+/* names of the selected algorithm and of the implementations in use */
+extern const char *cksum_algorithm(void);
+extern const char *cksum_implementation(void);
+
+/* checksum of a packet: seqnum, acknum, length and the used payload */
+extern int cksum_packet(struct pkt *);
+
+/* running CRC-32C over a byte stream with the fastest implementation; */
+/* start from 0xffffffff and complement the final state               */
+extern unsigned int crc32c_update(unsigned int, const unsigned char *, size_t);
+
+/* every implementation, for the micro-benchmark.  update() continues a */
+/* running state over len more bytes; all implementations of the same   */
+/* algorithm produce the same state.                                    */
+struct cksum_impl {
+  int algorithm;                          /* CKSUM_SUM, CKSUM_INET or CKSUM_CRC32C */
+  const char *name;                       /* "scalar", "sse2", "avx2", "sse4.2" ... */
+  int (*usable)(void);                    /* non zero if the CPU supports it */
+  unsigned int (*update)(unsigned int, const unsigned char *, size_t);
+  size_t minbytes;                        /* used from this many bytes on, shorter */
+                                          /* buffers go to the next one           */
+};
+extern const struct cksum_impl cksum_impls[];
+extern const int ncksum_impls;
+extern const char *cksum_names[];         /* indexed by algorithm */
@@ -0,0 +1,150 @@
+/* ******************************************************************
+   CHECKSUM MICRO-BENCHMARK
+
+   Runs every checksum implementation in checksum.c that this CPU
+   supports over buffers of typical packet sizes and reports bytes per
+   cycle.  On x86 cycles are read with rdtsc (reference cycles, which
+   equal core cycles only with turbo and frequency scaling off);
+   elsewhere nanoseconds are used instead.  Before timing, every
+   implementation is checked against the scalar one of its algorithm on
+   random buffers of odd lengths and alignments.  Implementations used
+   only from some length on (minbytes in checksum.c) say so; their
+   figures below that length show why.
+
+   Build:  cc -O2 -o cksumbench cksumbench.c checksum.c
+   Usage:  cksumbench [megabytes-per-measurement]
+   ********************************************************************* */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "checksum.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define UNIT "bytes/cycle"
+static uint64_t ticks(void)
+{
+  return __rdtsc();
+}
+#else
+#define UNIT "bytes/ns"
+static uint64_t ticks(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+#define BUFBYTES (65536 + 64)
+
+static const size_t sizes[] = { 20, 64, 256, 1500, 9000, 65536 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* the scalar implementation of an algorithm, the reference for checks */
+static const struct cksum_impl *reference(int algorithm)
+{
+  int i;
+
+  for (i=0; i<ncksum_impls; i++)
+    if (cksum_impls[i].algorithm == algorithm && strcmp(cksum_impls[i].name, "scalar") == 0)
+      return &cksum_impls[i];
+  return NULL;
+}
+
+/* compare every usable implementation with the reference; returns the
+   number of mismatches */
+static int verify(unsigned char *buf)
+{
+  const struct cksum_impl *impl, *ref;
+  size_t len, off;
+  unsigned int state;
+  int i, trial, bad = 0;
+
+  for (i=0; i<ncksum_impls; i++) {
+    impl = &cksum_impls[i];
+    ref = reference(impl->algorithm);
+    if (!impl->usable() || impl == ref)
+      continue;
+    for (trial=0; trial<2000; trial++) {
+      len = rand() % 4096;
+      off = rand() % 64;
+      state = (impl->algorithm == CKSUM_INET) ? (unsigned int)(rand() & 0xffff) : (unsigned int)rand();
+      if (impl->update(state, buf + off, len) != ref->update(state, buf + off, len)) {
+        printf("MISMATCH: %s/%s differs from %s/%s for %lu bytes at offset %lu\n",
+               cksum_names[impl->algorithm], impl->name,
+               cksum_names[ref->algorithm], ref->name,
+               (unsigned long)len, (unsigned long)off);
+        bad++;
+        break;
+      }
+    }
+  }
+  return bad;
+}
+
+int main(int argc, char **argv)
+{
+  const struct cksum_impl *impl;
+  unsigned char *buf;
+  volatile unsigned int sink = 0;
+  unsigned int state;
+  uint64_t start, best, t;
+  long megabytes, reps, r;
+  size_t s;
+  int i, round;
+
+  megabytes = (argc > 1) ? atol(argv[1]) : 64;
+  if (megabytes < 1) {
+    fprintf(stderr, "usage: %s [megabytes-per-measurement]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  buf = malloc(BUFBYTES);
+  if (buf == 0) {
+    printf("memory allocation for buffer failed.");
+    return EXIT_FAILURE;
+  }
+  srand(9999);
+  for (i=0; i<BUFBYTES; i++)
+    buf[i] = rand();
+
+  if (verify(buf) != 0)
+    return EXIT_FAILURE;
+
+  printf("%-8s %-8s", "checksum", "impl");
+  for (s=0; s<NSIZES; s++)
+    printf(" %10lu", (unsigned long)sizes[s]);
+  printf("   (%s, best of 3)\n", UNIT);
+
+  for (i=0; i<ncksum_impls; i++) {
+    impl = &cksum_impls[i];
+    if (!impl->usable())
+      continue;
+    printf("%-8s %-8s", cksum_names[impl->algorithm], impl->name);
+    for (s=0; s<NSIZES; s++) {
+      reps = megabytes * 1048576 / sizes[s];
+      best = 0;
+      for (round=0; round<3; round++) {
+        state = 0;
+        start = ticks();
+        for (r=0; r<reps; r++)
+          state = impl->update(state, buf, sizes[s]);
+        t = ticks() - start;
+        sink += state;
+        if (best == 0 || t < best)
+          best = t;
+      }
+      printf(" %10.3f", best ? (double)reps * sizes[s] / best : 0.0);
+    }
+    if (impl->minbytes > 0)
+      printf("   (used from %lu bytes)", (unsigned long)impl->minbytes);
+    printf("\n");
+  }
+  free(buf);
+  return EXIT_SUCCESS;
+}
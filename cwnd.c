@@ -0,0 +1,189 @@
+/* ******************************************************************
+   CONGESTION WINDOW
+
+   Slow start and AIMD on top of the fixed send buffer of GBN and SR, so
+   the sender backs off when the channel is lossy or its queue is full
+   (-q in the emulator) instead of always keeping the whole buffer in
+   flight.
+   - cwnd is kept in packets as a double, so additive increase can add
+   1/cwnd per ACKed packet; the sender uses its integer part
+   - after a cut, further loss signals are ignored until the window
+   moves on, so one burst of losses costs one halving (as in NewReno)
+   - with -w the window is written out whenever its integer part or
+   ssthresh changes, for plotting against time
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "emulator.h"
+#include "checkpoint.h"
+#include "cwnd.h"
+
+int use_cwnd = 0;
+
+static int cap;                     /* the sender's buffer size */
+static double cwnd, ssthresh;
+static int dupacks;                 /* duplicate ACKs in a row */
+static int recovering;              /* cut already, waiting for the window to move */
+
+/* time series */
+static FILE *logfp;
+static char logpath[4096];
+
+/* statistics */
+static int timeouts, cuts;
+static double lastchange, area;     /* integral of cwnd over time */
+
+static void logwindow(const char *event)
+{
+  if (logfp != NULL)
+    fprintf(logfp, "%f %d %d %s\n", get_sim_time(), (int)cwnd, (int)ssthresh, event);
+}
+
+/* set the window, keeping the time average up to date.  Growth is only
+   logged when it reaches another whole packet. */
+static void setwindow(double w, const char *event, int growing)
+{
+  double now = get_sim_time();
+  int old = (int)cwnd;
+
+  if (w > cap)
+    w = cap;
+  if (w < 1.0)
+    w = 1.0;
+  area += cwnd * (now - lastchange);
+  lastchange = now;
+  cwnd = w;
+  if (!growing || (int)cwnd != old)
+    logwindow(event);
+}
+
+void cwnd_init(int n)
+{
+  cap = n;
+  cwnd = use_cwnd ? 1.0 : cap;
+  ssthresh = cap;
+  dupacks = 0;
+  recovering = 0;
+  timeouts = cuts = 0;
+  lastchange = area = 0.0;
+  logwindow("init");
+}
+
+int cwnd_window(void)
+{
+  return (int)cwnd;
+}
+
+void cwnd_acked(int n)
+{
+  double w = cwnd;
+
+  if (!use_cwnd || n <= 0)
+    return;
+  dupacks = 0;
+  recovering = 0;
+  while (n-- > 0)
+    w += (w < ssthresh) ? 1.0 : 1.0 / w;
+  setwindow(w, cwnd < ssthresh ? "slowstart" : "avoidance", 1);
+}
+
+/* multiplicative decrease, once per window */
+static int cut(const char *event)
+{
+  if (recovering)
+    return 0;
+  recovering = 1;
+  cuts++;
+  ssthresh = cwnd / 2 < 2.0 ? 2.0 : cwnd / 2;
+  setwindow(ssthresh, event, 0);
+  return 1;
+}
+
+int cwnd_dupack(void)
+{
+  if (!use_cwnd)
+    return 0;
+  return ++dupacks == 3 && cut("dupack");
+}
+
+void cwnd_loss(void)
+{
+  if (use_cwnd)
+    cut("nak");
+}
+
+void cwnd_timeout(void)
+{
+  if (!use_cwnd)
+    return;
+  timeouts++;
+  dupacks = 0;
+  recovering = 1;
+  ssthresh = cwnd / 2 < 2.0 ? 2.0 : cwnd / 2;
+  setwindow(1.0, "timeout", 0);
+}
+
+unsigned long cwnd_state(void)
+{
+  return (((unsigned long)(cwnd * 4096) * 31 + (unsigned long)(ssthresh * 4096)) * 31 + dupacks) * 2 + recovering;
+}
+
+void cwnd_log(const char *path)
+{
+  use_cwnd = 1;
+  logfp = fopen(path, "w");
+  if (logfp == NULL) {
+    fprintf(stderr, "cwnd: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  snprintf(logpath, sizeof(logpath), "%s", path);
+  fprintf(logfp, "# time cwnd ssthresh event\n");
+}
+
+void cwnd_report(void)
+{
+  double now = get_sim_time();
+
+  if (!use_cwnd)
+    return;
+  if (logfp != NULL) {
+    logwindow("end");
+    fclose(logfp);
+    logfp = NULL;
+  }
+  printf("congestion window:  mean %f packets (buffer %d), %d cuts, %d timeouts, final cwnd %f ssthresh %f \n",
+         now > 0.0 ? (area + cwnd * (now - lastchange)) / now : cwnd, cap, cuts, timeouts, cwnd, ssthresh);
+}
+
+void cwnd_checkpoint(void)
+{
+  long offset = 0;
+
+  ckpt_tag("cwnd");
+  CKPT(use_cwnd);
+  CKPT(cap);
+  CKPT(cwnd);
+  CKPT(ssthresh);
+  CKPT(dupacks);
+  CKPT(recovering);
+  CKPT(timeouts);
+  CKPT(cuts);
+  CKPT(lastchange);
+  CKPT(area);
+  if (!ckpt_restoring() && logfp != NULL) {
+    fflush(logfp);
+    offset = ftell(logfp);
+  }
+  ckpt_string(logpath, sizeof(logpath));
+  CKPT(offset);
+  /* a resumed run carries on with the series as it was at the checkpoint */
+  if (ckpt_restoring() && logpath[0] != '\0') {
+    if (logfp != NULL)
+      fclose(logfp);
+    if (truncate(logpath, offset) < 0 || (logfp = fopen(logpath, "a")) == NULL) {
+      fprintf(stderr, "cwnd: cannot reopen %s\n", logpath);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
@@ -0,0 +1,44 @@
+/* congestion window for the sender, shared by GBN and SR (-W).  The    */
+/* window starts at one packet and grows by one per packet ACKed (slow  */
+/* start) up to ssthresh, then by one per window (additive increase).   */
+/* A timeout halves ssthresh and drops the window back to one packet;   */
+/* three duplicate ACKs, or a NAK, halve it (multiplicative decrease),  */
+/* at most once until the window moves on.  The window never exceeds   */
+/* the protocol's buffer, so without -W the sender works as before.    */
+
+/* non zero when the congestion window is in use */
+extern int use_cwnd;
+
+/* reset the window; the sender's buffer size is its upper bound */
+extern void cwnd_init(int);
+
+/* number of packets the sender may have outstanding now */
+extern int cwnd_window(void);
+
+/* the window moved on by this many packets */
+extern void cwnd_acked(int);
+
+/* an ACK that did not move the window; non zero on the third in a row, */
+/* when the window has been cut and the sender should resend at once    */
+extern int cwnd_dupack(void);
+
+/* explicit loss signal from the receiver (a NAK) */
+extern void cwnd_loss(void);
+
+/* the retransmission timer went off */
+extern void cwnd_timeout(void);
+
+/* hybrid mode (-H -H): a number that tells apart windows that behave */
+/* differently; it stays the same once the window has reached the     */
+/* sender's buffer and nothing cuts it                                 */
+extern unsigned long cwnd_state(void);
+
+/* write every change of the window to this file as "time cwnd ssthresh */
+/* event"; also turns the window on                                     */
+extern void cwnd_log(const char *);
+
+/* print the time averaged window and the number of cuts */
+extern void cwnd_report(void);
+
+/* save or restore the window in a checkpoint (checkpoint.h) */
+extern void cwnd_checkpoint(void);
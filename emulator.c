@@ -33,11 +33,137 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Extensions:
+   - variable length payloads up to MAXPAYLOAD bytes.  The MTU (-m) and
+   the application message size (-s) are chosen on the command line;
+   messages larger than the MTU are segmented by layer 5 before being
+   passed to A_output().  With a link rate (-r, bytes per time unit) the
+   one way delay also includes the time to serialise the packet.
+   Without options the emulator behaves exactly as before (20 byte
+   messages, size independent delay).
+   - packets are reference counted (pktbuf.c) and passed by pointer, so
+   the event list holds a reference to the sender's own packet instead
+   of a copy.  Only a packet that the channel corrupts is copied first.
+   - the packet checksum algorithm is selected with -k (sum, inet or
+   crc32c, see checksum.c); SIMD or scalar code is picked at run time.
+   - with -f, layer 5 at A streams the contents of a file instead of
+   repeated letters and layer 5 at B writes what it receives to the file
+   given with -o; the transfer is verified and timed at the end
+   (filexfer.c).  The number of messages asked for at start up is then
+   ignored, the run sends the whole file.
+   - the arrival process of layer 5 messages is selected with -a
+   (uniform, poisson, Pareto on/off or a trace file, see traffic.c).
+   - -p prefix profiles the event loop: calls and cycles per event type
+   and per emulator routine, and the event list length over time, are
+   printed at the end and written to prefix.folded / prefix.evlist
+   (profile.c).
+   - -B prints one line of JSON at the end with the events simulated,
+   wall clock time, peak RSS and goodput; bench.sh runs a fixed set of
+   scenarios with it.
+   - -C file saves the whole simulation every -i time units (and on
+   SIGINT or SIGTERM, after which the run stops); -R file resumes from
+   such a checkpoint and carries on exactly as the original run would
+   have (checkpoint.c).  A resumed run can change the loss (-l) and
+   corruption (-c) probabilities or the number of messages (-n), to
+   branch several what-if runs off one warm-up.  rand() has no state
+   that can be saved, so the number of draws is saved instead and
+   replayed from the seed on resume.
+   - the delivery latency of every segment, from A_output() to layer 5
+   at B, is reported as mean, percentiles and maximum (latency.c).
+   - -N makes the SR receiver send a NAK for every gap it sees, so the
+   sender resends the missing packet at once instead of waiting for its
+   timer.  Resends caused by NAKs are counted separately.
+   - -F k adds one XOR parity packet per k data packets, from which the
+   receiver rebuilds a single lost or corrupted packet (fec.c).
+   - -W gives the sender a congestion window with slow start and AIMD
+   (cwnd.c), -w file logs it over time.  -q n makes the channel a
+   bottleneck with room for n packets in each direction: a packet sent
+   while n are still on their way is dropped, so together with a link
+   rate (-r) the window can be seen to collapse or to settle.
+   - -x and -t set the protocol's window and timeout at run time.  -T
+   goodput or -T p99 tunes them instead of running one simulation:
+   seeded replicas of the channel given at start up are forked, -j at a
+   time, and the grid of windows and timeouts is narrowed down by
+   successive halving (tune.c, runner.c).
+   - -P precision replicates the run with other seeds, -j at a time,
+   until the 95% confidence interval of every reported figure is that
+   close to its mean (e.g. 0.02 for 2%), and prints the intervals
+   (replicate.c).
+   - -K dir keeps the results of these replicas on disk, keyed by the
+   whole configuration and the source version, so repeated sweeps only
+   simulate the points they have not seen (cache.c).
+   - -H (hybrid) is a per message shortcut for an idle sender: when a
+   message arrives with nothing in flight and no timer running, the
+   random draws its packet and ACK would take are looked at first.  If
+   neither is lost or corrupted and the ACK gets back before the timer
+   and the next arrival, the arrival, delivery and ACK are applied at
+   once instead of through the event list, and so on for the next
+   message.  The draws and the float arithmetic of each time are the
+   same as in the event loop, so the run is exactly the one without -H
+   (there is no error to trade for the speed); windows with several
+   packets in flight are simulated packet by packet.
+   - -H -H also advances over the steady state of a full window in
+   bulk.  After each ACK that reaches A the state of A and B (A_state(),
+   B_state()), of -F and -W, and the events pending are summed up in a
+   mark.  When a mark comes back at least 64 ACKs after an earlier one with nothing lost, corrupted, dropped, resent or
+   timed out in between, that stretch is repeated: time, the events
+   pending, every counter and the latencies of its deliveries move on
+   by the stretch up to 16 times in one go.  How many packets get
+   through before the next loss or corruption is drawn once for each
+   direction (geometric), the stretch is only repeated as far as that,
+   and the packet it names is then lost or corrupted by the channel.
+   The window positions need no moving: the sequence numbers have come
+   round to the same place.  This is no longer the same run as without
+   -H.  Over 100000 messages, with 0 to 0.2% loss and corruption, -x 1
+   to 32, -s, -F, -W, -N and poisson arrivals, goodput stayed within
+   1.5% of the full simulation and the mean latency within 5%, but up
+   to 15% for SR with rare losses and a wide window; the 99th
+   percentile stayed within 5% where it is set by the steady state,
+   and was off by up to 40% (once 180%) where it is set by the few
+   recoveries from a loss.  Where stretches do not come back (1% loss
+   with -x 32) the search costs up to 15% more time; loss free runs
+   are about 10 times faster.  A checkpoint starts the search again,
+   so -C changes where stretches are found, and a run resumed from it
+   ends as the run that saved it did.  It needs uniform or poisson
+   arrivals, since the gaps of the other processes depend on where in
+   the process the stretch falls, and no -f, whose data must travel in
+   its packets, or -M, whose paths keep timing of their own.
+   - -M scale[:loss],... replaces the channel with parallel paths, each
+   with its own queue, delay scale and loss.  A stripes its packets
+   across them round robin, or with -S rtt by the RTT and loss it
+   measures on each from the ACKs, which B sends back on the path their
+   packet came in on.  Paths can overtake each other, so GBN's receiver
+   then buffers packets that arrive early (multipath.c).
+   Build with: cc -o gbn emulator.c pktbuf.c checksum.c filexfer.c
+   traffic.c profile.c checkpoint.c latency.c fec.c cwnd.c runner.c
+   tune.c replicate.c cache.c multipath.c gbn.c -lm
+   optionally with -DSRCHASH=... to version the result cache by a hash
+   of the sources (cache.h)
+
    ********************************************************************* */
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <math.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "checksum.h"
+#include "filexfer.h"
+#include "traffic.h"
+#include "profile.h"
+#include "checkpoint.h"
+#include "latency.h"
+#include "fec.h"
+#include "cwnd.h"
+#include "runner.h"
+#include "tune.h"
+#include "replicate.h"
+#include "cache.h"
+#include "multipath.h"
 
 struct event {
   float evtime;           /* event time */
@@ -49,6 +175,7 @@ struct event {
 };
 
 struct event *evlist = NULL;   /* the event list */
+static int evlistlength = 0;   /* number of events on it */
 
 /* possible events: */
 #define  TIMER_INTERRUPT 0  
@@ -58,6 +185,8 @@ struct event *evlist = NULL;   /* the event list */
 #define  OFF             0
 #define  ON              1
 
+#define  HEADERBYTES     PKTHEADERBYTES  /* the packed header, see emulator.h */
+
 int TRACE = 3;
 
 /* statistics updated by GBN */
@@ -66,6 +195,13 @@ int total_ACKs_received;
 int packets_resent;       /* count of the number of packets resent  */
 int new_ACKs;           /* count of the number of acks correctly received */
 int packets_received;  /* count of the packets received by receiver */
+int naks_sent;         /* count of the NAKs sent by the receiver */
+int nak_resends;       /* count of the packets resent because of a NAK */
+
+int use_naks = 0;      /* -N */
+int window_size = 0;   /* -x */
+float rtt_timeout = 0.0; /* -t */
+int reordering = 0;    /* -M with more than one path */
 
 /* statistics updated by emulator */
 static int packets_lost;  
@@ -73,6 +209,8 @@ static int packets_corrupt;
 static int packets_sent;
 static int packets_timeout;
 static int messages_delivered;
+static long bytes_delivered;
+static int nsegments;             /* number of segments passed to layer 4 */
 
 static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
 static int nsimmax = 0;           /* number of msgs to generate, then stop */
@@ -84,22 +222,135 @@ static float lambda;        /* arrival rate of messages from layer 5 */
 static int   ntolayer3;           /* number sent into layer 3 */
 static int   nlost;               /* number lost in media */
 static int ncorrupt;              /* number corrupted by media*/
+static int mtu = 20;              /* largest payload per packet, -m */
+static int msgsize = 0;           /* application message size, -s (default mtu) */
+static float linkrate = 0.0;      /* bytes per time unit, -r (0 = size independent) */
+static int qlimit = 0;            /* -q: packets the channel holds each way (0 = no limit) */
+static int nqdrop;                /* number dropped because the channel was full */
+static char *profprefix = NULL;   /* -p: profile the run, output file prefix */
+static int bench = 0;             /* -B: print run statistics as JSON */
+static long nevents = 0;          /* events taken off the event list */
+static unsigned long ndraws = 0;  /* calls to rand() so far */
+static char *ckptpath = NULL;     /* -C: save checkpoints to this file */
+static double ckptinterval = 10000.0; /* -i: time units between checkpoints */
+static double nextckpt;           /* time of the next checkpoint */
+static char *resumepath = NULL;   /* -R: resume from this checkpoint */
+static float whatifloss = -1.0;   /* -l, -c, -n: change the run on resume */
+static float whatifcorrupt = -1.0;
+static int whatifnsim = -1;
+static volatile sig_atomic_t stopsignal = 0;  /* SIGINT or SIGTERM seen */
+static char *arrivals = "uniform"; /* -a: arrival process */
+static char *tunemetric = NULL;   /* -T: tune window and timeout for this metric */
+static double precision = 0.0;    /* -P: replicate to this relative precision */
+static int tunejobs = 0;          /* -j: replicas run at once (0 = one per CPU) */
+static int hybrid = 0;            /* -H: fast-forward messages sent from an idle sender */
+static int nforwarded;            /* messages fast-forwarded with -H */
+static double ahead[8];           /* draws looked at by peekrand() but not used yet */
+static int nahead, firstahead;
+static char *striping = NULL;     /* -S: how A picks a path */
+static int inpath;                /* -M: path of the packet being handled */
+static float insent;              /* and when A sent the packet it is or answers */
+static int inpathseq;
+static int nfromB;                /* packets sent into layer 3 by B */
+
+/* -H -H: the state at each of the last ACKs at A, to find a stretch that
+   repeats itself (steady()) */
+#define MAXMARKS 512
+#define MINCYCLE 64               /* fewest ACKs in a stretch that is repeated */
+#define MAXREPEAT 16              /* most repeats of one stretch before another is simulated */
+#define BOOKING 5.0               /* time units: how far ahead the channel is booked, roughly */
+static int *const steadycounts[] = {
+  &nsim, &window_full, &total_ACKs_received, &new_ACKs, &packets_received,
+  &messages_delivered, &nsegments, &ntolayer3, &nfromB
+};
+#define NSTEADY (int)(sizeof(steadycounts) / sizeof(steadycounts[0]))
+struct mark {
+  double time;
+  unsigned long state;            /* steadystate() */
+  long irregular;                 /* irregular() */
+  int count[NSTEADY];             /* *steadycounts[] */
+  long bytes;                     /* bytes_delivered */
+  long delivered;                 /* lat_count() */
+  int sent[2];                    /* packets sent by A and by B */
+  long fec[FEC_NCOUNTS];          /* fec_counts() */
+};
+static struct mark marks[MAXMARKS];
+static int nmarks, firstmark;
+#define MARKHASH 1024
+static unsigned short marked[MARKHASH]; /* marks kept, by state % MARKHASH */
+static long clear[2] = { -1, -1 }; /* packets from A and B still to get through */
+                                  /* before one is lost or corrupted; -1: not drawn */
+static int nbulk, nstretches;     /* messages and stretches advanced in bulk */
+#define LOST      1               /* channelfate() */
+#define CORRUPTED 2
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
 /* isolate all random number generation in one location.  We assume that the*/
 /* system-supplied rand() function return an int in therange [0,mmm]        */
 /****************************************************************************/
-double jimsrand(void) 
+static double drawrand(void)
 {
   double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;                   
+  ndraws++;
   x = rand()/mmm;            /* x should be uniform in [0,1] */
   if (TRACE > 3)
     printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
 }  
 
+double jimsrand(void) 
+{
+  double x;
+
+  if (nahead == 0)
+    return drawrand();
+  x = ahead[firstahead];     /* looked at already (-H) */
+  firstahead = (firstahead + 1) % 8;
+  nahead--;
+  return(x);
+}
+
+/* the i-th next draw of jimsrand(), without using it up */
+static double peekrand(int i)
+{
+  while (nahead <= i) {
+    ahead[(firstahead + nahead) % 8] = drawrand();
+    nahead++;
+  }
+  return ahead[(firstahead + i) % 8];
+}
+
+/* non zero if the channel loses and corrupts packets sent by AorB */
+static int inflicted(int AorB)
+{
+  return !(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B);
+}
+
+/* -H -H: what the channel does to the next packet from AorB, given its
+   loss draw u, once a stretch advanced in bulk has drawn how many more
+   get through: 0 if it does, LOST or CORRUPTED for the one after them,
+   and -1 when nothing has been drawn, so the usual draws decide */
+static int channelfate(int AorB, double u)
+{
+  double p;
+
+  if (clear[AorB] < 0)
+    return -1;
+  if (clear[AorB]-- > 0)
+    return 0;
+  p = 1.0 - (1.0 - lossprob) * (1.0 - corruptprob);
+  return (u * p < lossprob) ? LOST : CORRUPTED;
+}
+
+/* -H -H: forget the marks, after something irregular or at a checkpoint */
+static void dropmarks(void)
+{
+  for (; nmarks > 0; nmarks--)
+    marked[marks[(firstmark + nmarks - 1) % MAXMARKS].state % MARKHASH]--;
+}
+
 /********************* EVENT HANDLINE ROUTINES *******/
 /*  The next set of routines handle the event list   */
 /*****************************************************/
@@ -108,6 +359,8 @@ void insertevent(struct event *p)
 {
   struct event *q,*qold;
 
+  PROF_ENTER(PROF_INSERTEVENT);
+  evlistlength++;
   if (TRACE>2) {
     printf("            INSERTEVENT: time is %f\n",time);
     printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
@@ -139,6 +392,7 @@ void insertevent(struct event *p)
       q->prev=p;
     }
   }
+  PROF_EXIT(PROF_INSERTEVENT);
 }
 
 void generate_next_arrival(void)
@@ -146,11 +400,19 @@ void generate_next_arrival(void)
   double x;
   struct event *evptr;
 
+  PROF_ENTER(PROF_GENERATE);
   if (TRACE>2)
     printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
  
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+  if (traffic_uniform())
+    x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
   /* having mean of lambda        */
+  else if ((x = traffic_next()) < 0.0) {
+    if (TRACE>2)
+      printf("          GENERATE NEXT ARRIVAL: arrival trace has ended\n");
+    PROF_EXIT(PROF_GENERATE);
+    return;
+  }
   evptr = malloc(sizeof(struct event));
   if (evptr == 0) {
     printf("memory allocation for event failed.");
@@ -163,6 +425,7 @@ void generate_next_arrival(void)
   else
     evptr->eventity = A;
   insertevent(evptr);
+  PROF_EXIT(PROF_GENERATE);
 } 
 
 void printevlist(void)
@@ -175,10 +438,190 @@ void printevlist(void)
   printf("--------------\n");
 }
 
-void init(void)                         /* initialize the simulator */
+void init(int argc, char **argv)        /* initialize the simulator */
 {
   float sum, avg;
-  int i;
+  int i, c;
+  char *infile = NULL, *outfile = NULL, *cwndlog = NULL, *cachedir = NULL;
+
+  while ((c = getopt(argc, argv, "m:s:r:q:k:f:o:a:p:BC:i:R:l:c:n:NF:Ww:x:t:T:P:j:K:HM:S:")) != -1) {
+    switch (c) {
+    case 'm':
+      mtu = atoi(optarg);
+      break;
+    case 's':
+      msgsize = atoi(optarg);
+      break;
+    case 'r':
+      linkrate = atof(optarg);
+      break;
+    case 'q':
+      qlimit = atoi(optarg);
+      break;
+    case 'k':
+      if (cksum_select(optarg) < 0) {
+        fprintf(stderr, "%s: unknown checksum '%s' (sum, inet or crc32c)\n", argv[0], optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'f':
+      infile = optarg;
+      break;
+    case 'o':
+      outfile = optarg;
+      break;
+    case 'a':
+      arrivals = optarg;
+      break;
+    case 'p':
+      profprefix = optarg;
+      break;
+    case 'B':
+      bench = 1;
+      break;
+    case 'C':
+      ckptpath = optarg;
+      break;
+    case 'i':
+      ckptinterval = atof(optarg);
+      break;
+    case 'R':
+      resumepath = optarg;
+      break;
+    case 'l':
+      whatifloss = atof(optarg);
+      break;
+    case 'c':
+      whatifcorrupt = atof(optarg);
+      break;
+    case 'n':
+      whatifnsim = atoi(optarg);
+      break;
+    case 'N':
+      use_naks = 1;
+      break;
+    case 'F':
+      fec_block = atoi(optarg);
+      break;
+    case 'W':
+      use_cwnd = 1;
+      break;
+    case 'w':
+      cwndlog = optarg;
+      break;
+    case 'x':
+      window_size = atoi(optarg);
+      break;
+    case 't':
+      rtt_timeout = atof(optarg);
+      break;
+    case 'T':
+      tunemetric = optarg;
+      break;
+    case 'P':
+      precision = atof(optarg);
+      break;
+    case 'j':
+      tunejobs = atoi(optarg);
+      break;
+    case 'K':
+      cachedir = optarg;
+      break;
+    case 'H':
+      hybrid++;
+      break;
+    case 'M':
+      if (mp_open(optarg) < 0) {
+        fprintf(stderr, "%s: bad paths '%s' (scale[:loss],... with at most %d paths)\n", argv[0], optarg, MP_MAXPATHS);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'S':
+      striping = optarg;
+      if (mp_policy(optarg) < 0) {
+        fprintf(stderr, "%s: unknown striping '%s' (rr or rtt)\n", argv[0], optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-m mtu] [-s message-size] [-r bytes-per-time-unit] [-q queue-packets] [-k checksum] [-f input-file [-o output-file]] [-a arrivals] [-p profile-prefix] [-B] [-H [-H]] [-N] [-F k] [-W] [-w cwnd-log]\n"
+              "       [-x window] [-t timeout] [-T goodput|p99 | -P precision] [-j jobs] [-K cache-dir] [-M paths [-S rr|rtt]]\n"
+              "       [-C checkpoint [-i interval]] [-R checkpoint [-l loss] [-c corruption] [-n msgs]]\n"
+              "  -H applies a message, its delivery and its ACK at once when it finds nothing in flight\n"
+              "     and none of them is lost or corrupted; other messages are simulated as usual\n"
+              "  -H -H also repeats a stretch of the steady state in bulk up to the next loss or corruption:\n"
+              "     faster, but no longer the same run (see the top of emulator.c for how far off)\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (ckptpath != NULL && ckptinterval <= 0.0) {
+    fprintf(stderr, "%s: checkpoint interval must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  nextckpt = ckptinterval;
+  if (striping != NULL && mp_paths() == 0) {
+    fprintf(stderr, "%s: -S stripes across the paths given with -M\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  reordering = mp_paths() > 1;
+  if ((tunemetric != NULL || precision != 0.0) &&
+      (infile != NULL || ckptpath != NULL || resumepath != NULL || cwndlog != NULL)) {
+    fprintf(stderr, "%s: tuning and replication cannot transfer files, log the window or use checkpoints\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (precision < 0.0 || (precision > 0.0 && tunemetric != NULL)) {
+    fprintf(stderr, "%s: -P needs a positive precision and cannot be combined with -T\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (cachedir != NULL) {
+    if (tunemetric == NULL && precision == 0.0) {
+      fprintf(stderr, "%s: the result cache (-K) is used by -T and -P\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    cache_open(cachedir);
+  }
+  if (tunemetric != NULL && strcmp(tunemetric, "goodput") != 0 && strcmp(tunemetric, "p99") != 0) {
+    fprintf(stderr, "%s: the tuner optimises goodput or p99, not '%s'\n", argv[0], tunemetric);
+    exit(EXIT_FAILURE);
+  }
+  if (window_size < 0 || rtt_timeout < 0.0) {
+    fprintf(stderr, "%s: window and timeout must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (cwndlog != NULL)
+    cwnd_log(cwndlog);
+  if (resumepath != NULL) {
+    if (infile != NULL) {
+      fprintf(stderr, "%s: a resumed run takes its file transfer from the checkpoint\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    return;                   /* everything else comes from the checkpoint */
+  }
+  if (whatifloss >= 0.0 || whatifcorrupt >= 0.0 || whatifnsim >= 0) {
+    fprintf(stderr, "%s: -l, -c and -n only apply when resuming (-R)\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (mtu < 1 || mtu > MAXPAYLOAD) {
+    fprintf(stderr, "%s: MTU must be between 1 and %d bytes\n", argv[0], MAXPAYLOAD);
+    exit(EXIT_FAILURE);
+  }
+  if (fec_block < 0 || (fec_block > 0 && mtu > MAXPAYLOAD - FEC_HEADER)) {
+    fprintf(stderr, "%s: FEC needs a positive block size and an MTU of at most %d bytes\n",
+            argv[0], MAXPAYLOAD - FEC_HEADER);
+    exit(EXIT_FAILURE);
+  }
+  if (msgsize == 0)
+    msgsize = mtu;
+  if (msgsize < 1 || linkrate < 0.0 || qlimit < 0) {
+    fprintf(stderr, "%s: message size, link rate and queue size must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (outfile != NULL && infile == NULL) {
+    fprintf(stderr, "%s: -o needs an input file (-f)\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (infile != NULL)
+    xfer_open(infile, outfile);
 
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
@@ -195,6 +638,19 @@ void init(void)                         /* initialize the simulator */
   scanf("%f",&lambda);
   printf("Enter TRACE:");
   scanf("%d",&TRACE);
+  if (traffic_init(arrivals, lambda, 9999) < 0) {
+    fprintf(stderr, "%s: bad arrival process '%s' (uniform, poisson, onoff[:alpha[:on[:off]]] or trace:file)\n", argv[0], arrivals);
+    exit(EXIT_FAILURE);
+  }
+  if (hybrid == 1 && (!traffic_uniform() || msgsize > mtu || infile != NULL || fec_block > 0 || use_cwnd ||
+                      mp_paths() > 0)) {
+    fprintf(stderr, "%s: -H needs uniform arrivals, one packet per message and no -f, -F, -W or -M\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (hybrid > 1 && (!traffic_stationary() || infile != NULL || mp_paths() > 0)) {
+    fprintf(stderr, "%s: -H -H needs uniform or poisson arrivals and no -f or -M\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
 
 
   srand(9999);              /* init random number generator */
@@ -215,28 +671,198 @@ void init(void)                         /* initialize the simulator */
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  naks_sent = 0;
+  nak_resends = 0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
   packets_timeout = 0;
   messages_delivered = 0;
+  bytes_delivered = 0;
+  nsegments = 0;
 
   ntolayer3 = 0;
   nlost = 0;
   ncorrupt = 0;
+  nqdrop = 0;
 
   time=0.0;                    /* initialize time to 0.0 */
   generate_next_arrival();     /* initialize event list */
 }
 
+/* save or restore everything in the emulator, then the other modules */
+static void checkpoint(void)
+{
+  struct event *q, *last;
+  unsigned long draws;
+  char cksum[16];
+  int i, n;
+
+  ckpt_tag("emulator");
+  CKPT(time);
+  CKPT(nsim);
+  CKPT(nsimmax);
+  CKPT(lossprob);
+  CKPT(corruptprob);
+  CKPT(corruptdirection);
+  CKPT(lambda);
+  CKPT(mtu);
+  CKPT(msgsize);
+  CKPT(linkrate);
+  CKPT(qlimit);
+  CKPT(nqdrop);
+  CKPT(TRACE);
+  CKPT(window_full);
+  CKPT(total_ACKs_received);
+  CKPT(packets_resent);
+  CKPT(new_ACKs);
+  CKPT(packets_received);
+  CKPT(naks_sent);
+  CKPT(nak_resends);
+  CKPT(use_naks);
+  CKPT(window_size);
+  CKPT(rtt_timeout);
+  CKPT(packets_lost);
+  CKPT(packets_corrupt);
+  CKPT(packets_sent);
+  CKPT(packets_timeout);
+  CKPT(messages_delivered);
+  CKPT(bytes_delivered);
+  CKPT(nsegments);
+  CKPT(ntolayer3);
+  CKPT(nlost);
+  CKPT(ncorrupt);
+  CKPT(nevents);
+  draws = ndraws - nahead;        /* draws looked ahead at (-H) are made again */
+  CKPT(draws);
+  if (ckpt_restoring()) {
+    ndraws = draws;
+    nahead = 0;
+  }
+  CKPT(nextckpt);
+  CKPT(hybrid);
+  CKPT(nforwarded);
+  /* -H -H: a checkpoint starts the search for a steady state again, so
+     the resumed run finds the same stretches as the one saved */
+  CKPT(nfromB);
+  CKPT(clear);
+  CKPT(nbulk);
+  CKPT(nstretches);
+  dropmarks();
+  if (!ckpt_restoring())
+    snprintf(cksum, sizeof(cksum), "%s", cksum_algorithm());
+  ckpt_string(cksum, sizeof(cksum));
+  if (ckpt_restoring() && cksum_select(cksum) < 0) {
+    fprintf(stderr, "checkpoint: unknown checksum '%s'\n", cksum);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the event list, in time order.  Only packet arrivals carry a packet */
+  ckpt_tag("events");
+  n = evlistlength;
+  CKPT(n);
+  if (ckpt_restoring()) {
+    last = NULL;
+    for (i=0; i<n; i++) {
+      q = malloc(sizeof(struct event));
+      if (q == 0) {
+        printf("memory allocation for event failed.");
+        exit(EXIT_FAILURE);
+      }
+      CKPT(q->evtime);
+      CKPT(q->evtype);
+      CKPT(q->eventity);
+      q->pktptr = NULL;
+      if (q->evtype == FROM_LAYER3) {
+        ckpt_pkt(&q->pktptr);
+        CKPT(*pktpath(q->pktptr));
+      }
+      q->prev = last;
+      q->next = NULL;
+      if (last == NULL)
+        evlist = q;
+      else
+        last->next = q;
+      last = q;
+    }
+    evlistlength = n;
+  }
+  else
+    for (q=evlist; q!=NULL; q=q->next) {
+      CKPT(q->evtime);
+      CKPT(q->evtype);
+      CKPT(q->eventity);
+      if (q->evtype == FROM_LAYER3) {
+        ckpt_pkt(&q->pktptr);
+        CKPT(*pktpath(q->pktptr));
+      }
+    }
+
+  traffic_checkpoint();
+  xfer_checkpoint();
+  lat_checkpoint();
+  fec_checkpoint();
+  cwnd_checkpoint();
+  mp_checkpoint();
+  A_checkpoint();
+  B_checkpoint();
+}
+
+static void savecheckpoint(void)
+{
+  ckpt_begin(ckptpath, 1);
+  checkpoint();
+  ckpt_end();
+  if (TRACE>1)
+    printf("          CHECKPOINT: saved to %s at time %f\n", ckptpath, time);
+}
+
+static void resume(void)
+{
+  unsigned long n;
+  int naks = use_naks;
+
+  ckpt_begin(resumepath, 0);
+  checkpoint();
+  ckpt_end();
+  if (naks)
+    use_naks = 1;             /* -N can be switched on for a what-if run */
+  reordering = mp_paths() > 1;
+  /* bring rand() back to where it was: same seed, same number of draws */
+  srand(9999);
+  for (n=0; n<ndraws; n++)
+    rand();
+  printf("resumed from %s at time %f after %d msgs from layer5\n", resumepath, time, nsim);
+  if (whatifloss >= 0.0)
+    lossprob = whatifloss;
+  if (whatifcorrupt >= 0.0)
+    corruptprob = whatifcorrupt;
+  if (whatifloss >= 0.0 || whatifcorrupt >= 0.0)
+    clear[A] = clear[B] = -1;   /* drawn for the old channel (-H -H) */
+  if (whatifnsim >= 0)
+    nsimmax = whatifnsim;
+}
+
+/* SIGINT or SIGTERM with -C: checkpoint before the next event and stop */
+static void stophandler(int sig)
+{
+  stopsignal = sig;
+}
+
 /********************** Student-callable ROUTINES ***********************/
 
+double get_sim_time(void)
+{
+  return time;
+}
+
 /* called by students routine to cancel a previously-started timer */
 void stoptimer(int AorB)
 /* A or B is trying to stop timer */
 {
   struct event *q;
 
+  PROF_ENTER(PROF_STOPTIMER);
   if (TRACE>1)
     printf("          STOP TIMER: stopping timer at %f\n",time);
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
@@ -256,9 +882,12 @@ void stoptimer(int AorB)
         q->prev->next =  q->next;
       }
       free(q);
+      evlistlength--;
+      PROF_EXIT(PROF_STOPTIMER);
       return;
     }
   printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  PROF_EXIT(PROF_STOPTIMER);
 }
 
 
@@ -269,6 +898,7 @@ void starttimer(int AorB, double increment)
   struct event *q;
   struct event *evptr;
 
+  PROF_ENTER(PROF_STARTTIMER);
   if (TRACE>1)
     printf("          START TIMER: starting timer at %f\n",time);
   /* be nice: check to see if timer is already started, if so, then  warn */
@@ -276,6 +906,7 @@ void starttimer(int AorB, double increment)
   for (q=evlist; q!=NULL ; q = q->next)  
     if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
       printf("Warning: attempt to start a timer that is already started\n");
+      PROF_EXIT(PROF_STARTTIMER);
       return;
     }
  
@@ -291,44 +922,71 @@ void starttimer(int AorB, double increment)
  
   evptr->eventity = AorB;
   insertevent(evptr);
+  PROF_EXIT(PROF_STARTTIMER);
 } 
 
 
 /************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
+void tolayer3(int AorB, struct pkt *packet)
 /* A or B is sending to network  */
 {
   struct pkt *mypktptr;
   struct event *evptr,*q;
-  float lastime, x;
-  int i;
+  float lastime, x, loss;
+  double u;
+  int i, queued, path, pathseq, paths, fate;
 
+  PROF_ENTER(PROF_TOLAYER3);
   ntolayer3++;
+  if (AorB == B)
+    nfromB++;
+
+  /* FEC parity packets carry a small header on top of the MTU */
+  if (packet->length < 0 || packet->length > mtu + (fec_block > 0 ? FEC_HEADER : 0)) {
+    printf("TOLAYER3: packet length %d is outside 0..%d (the MTU)\n", packet->length, mtu);
+    exit(EXIT_FAILURE);
+  }
+
+  /* -M: A stripes its packets over the paths, B answers on the path */
+  /* the packet it is handling came in on                          */
+  path = pathseq = 0;
+  loss = lossprob;
+  paths = mp_paths();
+  if (paths > 0) {
+    path = (AorB == A) ? mp_choose() : inpath;
+    pathseq = mp_sent(path, AorB, AorB == A && (*pktsends(packet))++ > 0);
+    if (mp_loss(path) >= 0.0)
+      loss = mp_loss(path);
+  }
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+  u = jimsrand();
+  fate = channelfate(AorB, u);
+  if ((fate < 0) ? u < loss && inflicted(AorB) : fate == LOST) {
     nlost++;
+    if (paths > 0)
+      mp_lost(path, AorB);
     if (TRACE>0)    
       printf("          TOLAYER3: packet being lost\n");
+    PROF_EXIT(PROF_TOLAYER3);
     return;
   }  
 
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+  /* share the student's packet rather than copying it; packets given to */
+  /* layer 3 are not modified by the student afterwards.  With paths   */
+  /* each trip needs its own path record (pktpath()), so copy it then  */
+  if (paths > 0) {
+    mypktptr = copypkt(packet);
+    pktpath(mypktptr)->path = path;
+    pktpath(mypktptr)->sent = (AorB == A) ? time : insent;  /* echoed back to A */
+    pktpath(mypktptr)->seq = (AorB == A) ? pathseq : inpathseq;
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
+  else
+    mypktptr = holdpkt(packet);
   if (TRACE>2)  {
     printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
            mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
+    for (i=0; i<mypktptr->length; i++)
       printf("%c",mypktptr->payload[i]);
     printf("\n");
   }
@@ -347,19 +1005,61 @@ void tolayer3(int AorB, struct pkt packet)
      time units after the latest arrival time of packets
      currently in the medium on their way to the destination */
   lastime = time;
+  queued = 0;
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
+  if (paths == 0) {
+    for (q=evlist; q!=NULL ; q = q->next) 
+      if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) {
+        lastime = q->evtime;
+        queued++;
+      }
+  }
+  else {
+    /* -M: each path is a channel of its own */
+    for (q=evlist; q!=NULL ; q = q->next)
+      if (q->evtype==FROM_LAYER3 && q->eventity==evptr->eventity && pktpath(q->pktptr)->path==path) {
+        lastime = q->evtime;
+        queued++;
+      }
+  }
+
+  /* a bottleneck drops what it has no room for (-q) */
+  if (qlimit > 0 && queued >= qlimit) {
+    nqdrop++;
+    if (paths > 0)
+      mp_lost(path, AorB);
+    if (TRACE>0)
+      printf("          TOLAYER3: channel full, packet dropped\n");
+    releasepkt(mypktptr);
+    free(evptr);
+    PROF_EXIT(PROF_TOLAYER3);
+    return;
+  }
+  if (paths > 0 && mp_scale(path) != 1.0)
+    evptr->evtime = lastime + mp_scale(path) * (1 + 9*jimsrand());
+  else
+    evptr->evtime =  lastime + 1 + 9*jimsrand();
+  if (linkrate > 0.0)           /* serialisation delay of this packet */
+    evptr->evtime += (HEADERBYTES + packet->length) / linkrate;
  
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+  u = jimsrand();
+  if ((fate < 0) ? u < corruptprob && inflicted(AorB) : fate == CORRUPTED) {
     ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
+    /* copy on write: the sender still holds the original */
+    if (paths == 0) {
+      mypktptr = copypkt(packet);
+      releasepkt(packet);
+      evptr->pktptr = mypktptr;
+    }
+    if ( (x = jimsrand()) < .75) {
+      if (mypktptr->length > 0)
+        mypktptr->payload[0]='Z';   /* corrupt payload */
+      else
+        mypktptr->acknum = 999999;  /* no payload (an ACK): hit the header */
+    }
     else if (x < .875)
       mypktptr->seqnum = 999999;
     else
@@ -371,44 +1071,309 @@ void tolayer3(int AorB, struct pkt packet)
   if (TRACE>2)  
     printf("          TOLAYER3: scheduling arrival on other side\n");
   insertevent(evptr);
+  PROF_EXIT(PROF_TOLAYER3);
 } 
 
-void tolayer5(int AorB, char datasent[20])
+void tolayer5(int AorB, char datasent[], int length)
 {
   int i;  
+  PROF_ENTER(PROF_TOLAYER5);
   if (TRACE>2) {
     printf("          TOLAYER5: data received by application at ");
     if (AorB == A) 
       printf("A: ");
     else
       printf("B: ");
-    for (i=0; i<20; i++)  
+    for (i=0; i<length; i++)  
       printf("%c",datasent[i]);
     printf("\n");
   }
+  if (AorB == B)
+    lat_delivered(time);
   messages_delivered++;
+  bytes_delivered += length;
+  if (AorB == B && xfer_active())
+    xfer_deliver(datasent, length);
+  PROF_EXIT(PROF_TOLAYER5);
 }
 
-int main(void)
+/* -H: the arrival at the current time finds nothing in flight and no
+   timer running.  While the next message would be delivered and ACKed
+   without loss or corruption before A's timer, the next arrival and the
+   next checkpoint, apply its events at once: the times are worked out
+   with the same draws and the same float arithmetic as the event loop's.
+   Returns 0 if the first message has to be simulated; otherwise the
+   arrival of the first one that does is put on the event list. */
+static int fastforward(void)
+{
+  struct event *evptr;
+  double x, timeout;
+  float now, tnext, t1, t2;
+  int n, i;
+
+  timeout = A_idle();
+  if (TRACE > 0 || timeout <= 0.0 || xfer_active() || use_cwnd || fec_block > 0 ||
+      msgsize > mtu || !traffic_uniform() || mp_paths() > 0)
+    return 0;
+  now = time;                    /* when the message arrives */
+  for (n=0; nsim < nsimmax && !stopsignal; n++) {
+    x = lambda*peekrand(0)*2;
+    /* the packet: loss, delay, corruption; then the same for its ACK */
+    if ((peekrand(1) < lossprob || peekrand(3) < corruptprob) && corruptdirection != B)
+      break;
+    if ((peekrand(4) < lossprob || peekrand(6) < corruptprob) && corruptdirection != A)
+      break;
+    tnext = now + x;
+    t1 = now + 1 + 9*peekrand(2);
+    if (linkrate > 0.0)
+      t1 += (HEADERBYTES + msgsize) / linkrate;
+    t2 = t1 + 1 + 9*peekrand(5);
+    if (linkrate > 0.0)
+      t2 += HEADERBYTES / linkrate;  /* the ACK has no payload */
+    if (!(t2 < tnext && t2 < (float)(now + timeout) && (ckptpath == NULL || t2 < nextckpt)))
+      break;
+
+    for (i=0; i<7; i++)
+      jimsrand();
+    nsim++;
+    nsegments++;
+    ntolayer3 += 2;
+    lat_sent(now);
+    lat_delivered(t1);
+    messages_delivered++;
+    bytes_delivered += msgsize;
+    A_fastforward();
+    B_fastforward();
+    nevents += (n > 0) ? 3 : 2;  /* the first arrival was taken off the list */
+    nforwarded++;
+    time = t2;                   /* the ACK was the last event */
+    now = tnext;
+  }
+  if (n == 0)
+    return 0;
+
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime = now;
+  evptr->evtype = FROM_LAYER5;
+  evptr->eventity = A;
+  insertevent(evptr);
+  return 1;
+}
+
+/* -H -H: a number for everything that decides what happens next apart
+   from the time and the counters: the state of the protocol, of FEC and
+   of the congestion window, what is on the event list, and how far
+   ahead each direction of the channel is booked, in steps of BOOKING.
+   The last keeps a stretch in which the queue builds up or drains from
+   passing for one of the steady state. */
+static unsigned long steadystate(void)
+{
+  struct event *q;
+  unsigned long h;
+  int n[3][2] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
+  float booked[2];
+
+  booked[A] = booked[B] = time;
+  for (q=evlist; q!=NULL; q=q->next) {
+    n[q->evtype][q->eventity]++;
+    if (q->evtype == FROM_LAYER3)
+      booked[q->eventity] = q->evtime;
+  }
+  h = A_state() * 1000003ul ^ B_state();
+  h = h * 1000003ul ^ fec_state();
+  h = h * 1000003ul ^ cwnd_state();
+  h = h * 1000003ul ^ (unsigned long)((booked[A] - time) / BOOKING) * 1009 ^ (unsigned long)((booked[B] - time) / BOOKING);
+  return ((((h * 31 + n[0][A]) * 31 + n[1][A]) * 31 + n[2][A]) * 31 + n[2][B]) * 31 + n[0][B];
+}
+
+/* -H -H: packets lost, corrupted, dropped, resent or NAKed and timeouts
+   so far.  A stretch in which this changes is not steady. */
+static long irregular(void)
+{
+  return (long)nlost + ncorrupt + nqdrop + packets_resent + naks_sent + packets_timeout;
+}
+
+/* -H -H: the number of packets that get through before the next one is
+   lost or corrupted, when each one is with probability p */
+static long getthrough(double p)
+{
+  double n, u = jimsrand();
+
+  if (p >= 1.0)
+    return 0;
+  if (u <= 0.0)
+    return LONG_MAX / 2;
+  n = floor(log(u) / log(1.0 - p));
+  return (n < LONG_MAX / 2) ? (long)n : LONG_MAX / 2;
+}
+
+/* -H -H: the stretch from mark mk to now left every state as it found
+   it and had nothing irregular in it.  Repeat it as many times as fit,
+   up to MAXREPEAT, before the channel next loses or corrupts a packet,
+   the messages run out or the next checkpoint is due: every event still
+   to come moves on by the time that takes, and the counters and the
+   latencies go up by what the stretch added to them, that many times
+   over.  How many packets get through before the next loss or
+   corruption is drawn for each direction, with the probabilities the
+   packet by packet draws have; the repeats use up part of it, and
+   channelfate() sees to the rest once packets are simulated again, so
+   losses are as frequent as in the full simulation.  Returns 0 if not
+   even one repeat fits. */
+static int repeat(const struct mark *mk)
+{
+  struct event *q;
+  long sent[2], delivered, fec[FEC_NCOUNTS], times;
+  double span, shift, p;
+  int arrived, d, i;
+
+  span = time - mk->time;
+  arrived = nsim - mk->count[0];          /* nsim comes first */
+  delivered = lat_count() - mk->delivered;
+  sent[A] = (ntolayer3 - nfromB) - mk->sent[A];
+  sent[B] = nfromB - mk->sent[B];
+  if (span <= 0.0 || arrived <= 0 || delivered <= 0 || delivered > LAT_RECENT || stopsignal)
+    return 0;
+  times = (nsimmax - nsim) / arrived;
+  if (times > MAXREPEAT)
+    times = MAXREPEAT;
+  if (ckptpath != NULL) {
+    if ((nextckpt - time) / span < times)
+      times = (long)((nextckpt - time) / span);
+    if (times > 0 && time + times * span >= nextckpt)
+      times--;
+  }
+  for (d=A; d<=B; d++) {
+    p = inflicted(d) ? 1.0 - (1.0 - lossprob) * (1.0 - corruptprob) : 0.0;
+    if (p <= 0.0 || sent[d] == 0)
+      continue;
+    if (clear[d] < 0)
+      clear[d] = getthrough(p);
+    if (clear[d] / sent[d] < times)
+      times = clear[d] / sent[d];
+  }
+  if (times <= 0)
+    return 0;
+
+  shift = times * span;
+  for (d=A; d<=B; d++)
+    if (clear[d] >= 0)
+      clear[d] -= times * sent[d];
+  for (q=evlist; q!=NULL; q=q->next)
+    q->evtime = q->evtime + shift;
+  time = time + shift;
+  lat_shift(shift);
+  lat_repeat(delivered, times);
+  for (i=0; i<NSTEADY; i++)
+    *steadycounts[i] += times * (*steadycounts[i] - mk->count[i]);
+  bytes_delivered += times * (bytes_delivered - mk->bytes);
+  fec_counts(fec);
+  for (i=0; i<FEC_NCOUNTS; i++)
+    fec[i] -= mk->fec[i];
+  fec_repeat(fec, times);
+  nbulk += times * arrived;
+  nstretches++;
+  if (TRACE > 0)
+    printf("          HYBRID: the last %d messages (%f time units) repeated %ld times, to time %f\n",
+           arrived, span, times, time);
+  return 1;
+}
+
+/* -H -H: whether MINCYCLE ACKs in a row without a loss or corruption in
+   either direction are likely enough (one in a thousand) for steady() to
+   be worth its time */
+static int steadylikely(void)
+{
+  double q = 1.0;
+  int d;
+
+  for (d=A; d<=B; d++)
+    if (inflicted(d))
+      q *= (1.0 - lossprob) * (1.0 - corruptprob);
+  return pow(q, MINCYCLE) >= 0.001;
+}
+
+/* -H -H: called after every ACK at A.  Marks the state; if it was the same
+   at a mark at least MINCYCLE ACKs back, with nothing irregular since,
+   the stretch from there is one cycle of a steady state and repeat()
+   skips ahead over more of the same */
+static void steady(void)
+{
+  struct mark *mk;
+  unsigned long state;
+  long irr;
+  int i;
+
+  if (xfer_active() || mp_paths() > 0 || !traffic_stationary())
+    return;
+  state = steadystate();
+  irr = irregular();
+  if (nmarks > 0 && marks[(firstmark + nmarks - 1) % MAXMARKS].irregular != irr)
+    dropmarks();
+  for (i=0; marked[state % MARKHASH] > 0 && i + MINCYCLE <= nmarks; i++) {
+    mk = &marks[(firstmark + i) % MAXMARKS];   /* oldest first: the longest stretch */
+    if (mk->state == state) {
+      if (repeat(mk))
+        dropmarks();
+      break;
+    }
+  }
+
+  if (nmarks == MAXMARKS) {
+    marked[marks[firstmark].state % MARKHASH]--;
+    firstmark = (firstmark + 1) % MAXMARKS;
+    nmarks--;
+  }
+  mk = &marks[(firstmark + nmarks) % MAXMARKS];
+  nmarks++;
+  marked[state % MARKHASH]++;
+  mk->time = time;
+  mk->state = state;
+  mk->irregular = irr;
+  for (i=0; i<NSTEADY; i++)
+    mk->count[i] = *steadycounts[i];
+  mk->bytes = bytes_delivered;
+  mk->delivered = lat_count();
+  mk->sent[A] = ntolayer3 - nfromB;
+  mk->sent[B] = nfromB;
+  fec_counts(mk->fec);
+}
+
+/* run the event loop until no events are left; returns 0 if a signal
+   stopped it first, after saving a checkpoint */
+static int simulate(void)
 {
   struct event *eventptr;
   struct msg  msg2give;
-  struct pkt  pkt2give;
    
-  int i,j;
+  int i,j,sent,dropped;
+  int looking = hybrid > 1 && steadylikely();  /* -H -H */
   
-  init();
-  A_init();
-  B_init();
-   
   while (1) {
     eventptr = evlist;            /* get next event to simulate */
     if (eventptr==NULL)
-      goto terminate;
+      return 1;
+    if (ckptpath != NULL && (eventptr->evtime >= nextckpt || stopsignal)) {
+      while (nextckpt <= eventptr->evtime)
+        nextckpt += ckptinterval;
+      savecheckpoint();
+      if (stopsignal) {
+        printf(" Simulator stopped by signal %d at time %f, state saved to %s\n",
+               (int)stopsignal, time, ckptpath);
+        return 0;
+      }
+    }
     evlist = evlist->next;        /* remove this event from event list */
     if (evlist!=NULL)
       evlist->prev=NULL;
+    evlistlength--;
+    nevents++;
+    PROF_SAMPLE(eventptr->evtime, evlistlength);
     if (TRACE>=2) {
+      PROF_ENTER(PROF_TRACE);
       printf("\nEVENT time: %f,",eventptr->evtime);
       printf("  type: %d",eventptr->evtype);
       if (eventptr->evtype==0)
@@ -418,43 +1383,73 @@ int main(void)
       else
         printf(", fromlayer3 ");
       printf(" entity: %d\n",eventptr->eventity);
+      PROF_EXIT(PROF_TRACE);
     }
     time = eventptr->evtime;        /* update time to next event time */
+    PROF_ENTER(eventptr->evtype);
     if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
+      if (hybrid && evlist == NULL && fastforward())
+        ;                          /* up to the arrival of a message that is not idle */
+      else if (xfer_active() ? xfer_remaining() > 0 : nsim < nsimmax) {
         generate_next_arrival();   /* set up future arrival */
         /* fill in msg to give with string of same letter */    
         j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
+        if (!xfer_active())
+          for (i=0; i<mtu; i++)  
+            msg2give.data[i] = 97 + j;
         nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
+        /* segment the application message into MTU sized pieces */
+        for (sent=0; sent<msgsize; sent+=msg2give.length) {
+          msg2give.length = (msgsize - sent < mtu) ? msgsize - sent : mtu;
+          if (xfer_active()) {
+            msg2give.length = xfer_next(msg2give.data, msg2give.length);
+            if (msg2give.length == 0)
+              break;                  /* end of the file */
+          }
+          if (TRACE>2) {
+            printf("          MAINLOOP: data given to student: ");
+            for (i=0; i<msg2give.length; i++) 
+              printf("%c", msg2give.data[i]);
+            printf("\n");
+          }
+          nsegments++;
+          dropped = window_full;
+          if (eventptr->eventity == A) 
+            A_output(&msg2give);  
+          else
+            B_output(&msg2give);  
+          if (window_full == dropped)
+            lat_sent(time);
+          else if (xfer_active()) {
+            /* the sender refused it: offer the same bytes next time */
+            xfer_unread(msg2give.length);
+            break;
+          }
+        }
       }
       else if (TRACE > 2)
           printf("          FROM_LAYER5: no more messages to send: \n");
     }
     else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
+      if (mp_paths() > 0) {
+        inpath = pktpath(eventptr->pktptr)->path;
+        insent = pktpath(eventptr->pktptr)->sent;
+        inpathseq = pktpath(eventptr->pktptr)->seq;
+        if (eventptr->eventity == A)
+          mp_acked(inpath, time - insent, inpathseq);
+        else
+          mp_arrived(inpath, eventptr->pktptr->length);
+      }
 	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
+        A_input(eventptr->pktptr);     /* appropriate entity */
       else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
+        B_input(eventptr->pktptr);
+	    releasepkt(eventptr->pktptr);    /* drop the channel's reference */
+      if (looking && eventptr->eventity == A)
+        steady();
     }
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
+      packets_timeout++;
       if (eventptr->eventity == A) 
         A_timerinterrupt();
       else
@@ -463,10 +1458,96 @@ int main(void)
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
     }
+    PROF_EXIT(eventptr->evtype);
     free(eventptr);
   }
+}
+
+/* a replica for the tuner, in a child forked after init(): start again
+   from the replica's seed with its window, timeout and length */
+void run_replica(const struct runcfg *cfg, struct runresult *res)
+{
+  struct event *q;
+  int i;
+
+  if (cfg->window > 0)
+    window_size = cfg->window;
+  if (cfg->timeout > 0.0)
+    rtt_timeout = cfg->timeout;
+  nsimmax = cfg->nsim;
+  TRACE = 0;
+  /* init() drew the first arrival from the usual seed */
+  while ((q = evlist) != NULL) {
+    evlist = q->next;
+    free(q);
+  }
+  evlistlength = 0;
+  time = 0.0;
+  srand(cfg->seed);
+  ndraws = 0;
+  nahead = 0;
+  mp_init();
+  /* the same test draws as init(), so seed 9999 gives the usual run */
+  for (i=0; i<1000; i++)
+    jimsrand();
+  traffic_init(arrivals, lambda, cfg->seed);
+  generate_next_arrival();
+  A_init();
+  B_init();
+  simulate();
+
+  res->simtime = time;
+  res->bytes = bytes_delivered;
+  res->goodput = time > 0.0 ? bytes_delivered / time : 0.0;
+  res->mean = lat_mean();
+  res->p99 = lat_percentile(0.99);
+  res->delivered = messages_delivered;
+  res->resent = packets_resent;
+  res->refused = window_full;
+  res->acks = new_ACKs;
+}
+
+/* the result cache key: everything that init() and the options set and
+   that the replica does not override, then what it does */
+void run_describe(const struct runcfg *cfg, char *buf, size_t size)
+{
+  snprintf(buf, size, "%s|version %s|loss %.9g|corrupt %.9g|direction %d|lambda %.9g|arrivals %s"
+           "|trace %016llx|mtu %d|msgsize %d|linkrate %.9g|queue %d|checksum %s|naks %d|fec %d|cwnd %d"
+           "|paths %s|window %d|timeout %.9g|nsim %d|seed %u",
+           protocol_name, cache_version(), lossprob, corruptprob, corruptdirection, lambda, traffic_name(),
+           traffic_hash(), mtu, msgsize, linkrate, qlimit, cksum_algorithm(), use_naks, fec_block, use_cwnd, mp_name(),
+           cfg->window > 0 ? cfg->window : window_size, cfg->timeout > 0.0 ? cfg->timeout : rtt_timeout,
+           cfg->nsim, cfg->seed);
+}
+
+int main(int argc, char **argv)
+{
+  init(argc, argv);
+  if (tunemetric != NULL) {
+    tune(tunemetric, nsimmax, tunejobs > 0 ? tunejobs : run_jobs());
+    cache_report();
+    return EXIT_SUCCESS;
+  }
+  if (precision > 0.0) {
+    replicate(precision, nsimmax, tunejobs > 0 ? tunejobs : run_jobs());
+    cache_report();
+    return EXIT_SUCCESS;
+  }
+  A_init();
+  B_init();
+  if (resumepath != NULL)
+    resume();
+  if (ckptpath != NULL) {
+    signal(SIGINT, stophandler);
+    signal(SIGTERM, stophandler);
+  }
+  if (profprefix != NULL)
+    prof_start(profprefix);
+  if (bench)
+    prof_bench_start();
+  if (!simulate())
+    return EXIT_SUCCESS;
 
- terminate:
   printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
   printf("number of messages dropped due to full window:  %d \n", window_full);
   printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
@@ -474,5 +1555,31 @@ int main(void)
   printf("number of packet resends by A:  %d \n", packets_resent);
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (msgsize != mtu)
+    printf("number of segments passed to layer 4 (MTU %d, message size %d):  %d \n", mtu, msgsize, nsegments);
+  printf("number of bytes delivered to application:  %ld (%f bytes per time unit) \n",
+         bytes_delivered, time > 0.0 ? bytes_delivered / time : 0.0);
+  printf("checksum:  %s (%s) \n", cksum_algorithm(), cksum_implementation());
+  printf("arrivals:  %s \n", traffic_name());
+  lat_report();
+  if (use_naks)
+    printf("number of NAKs sent by B:  %d, packet resends caused by NAKs:  %d (the other %d after timeouts) \n",
+           naks_sent, nak_resends, packets_resent - nak_resends);
+  fec_report();
+  if (qlimit > 0)
+    printf("number of packets dropped by the full channel (%d packets each way):  %d \n", qlimit, nqdrop);
+  cwnd_report();
+  mp_report(bytes_delivered, time);
+  if (hybrid == 1)
+    printf("hybrid mode:  %d of %d messages fast-forwarded \n", nforwarded, nsim);
+  else if (hybrid > 1)
+    printf("hybrid mode:  %d of %d messages fast-forwarded, %d advanced in bulk in %d steady stretches \n",
+           nforwarded, nsim, nbulk, nstretches);
+  if (xfer_active())
+    xfer_report(time);
+  if (profprefix != NULL)
+    prof_report();
+  if (bench)
+    prof_bench_report(nevents, time, bytes_delivered, total_ACKs_received);
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -6,15 +6,32 @@ extern int packets_resent;       /* count of the number of packets resent  */
 extern int new_ACKs;      /* count of the number of acks correctly received */
 extern int packets_received;  /* count of the packets received by receiver */
 extern int window_full; /* count of the number of messages dropped due to full window */
+extern int naks_sent;     /* count of the NAKs sent by the receiver */
+extern int nak_resends;   /* count of the packets resent because of a NAK */
+
+/* protocol options, set on the command line */
+extern int use_naks;      /* -N: SR receiver sends a NAK for each gap it sees */
+extern int window_size;   /* -x: window in packets, 0 for the protocol's own */
+extern float rtt_timeout; /* -t: retransmission timeout, 0 for the protocol's own */
+extern int reordering;    /* -M: packets can overtake each other, GBN's receiver buffers them */
 
 #define   A    0
 #define   B    1
 
+/* largest payload a msg or pkt can carry.  The MTU actually used is   */
+/* chosen at run time (-m) and can be anything from 1 to MAXPAYLOAD.    */
+#ifndef MAXPAYLOAD
+#define MAXPAYLOAD 9000
+#endif
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
+/* Application messages larger than the MTU are segmented by layer 5, so  */
+/* length is never larger than the MTU.                                   */
 struct msg {
-  char data[20];
+  int length;                /* number of bytes used in data */
+  char data[MAXPAYLOAD];
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
@@ -24,17 +41,55 @@ struct pkt {
   int seqnum;
   int acknum;
   int checksum;
-  char payload[20];
+  int length;                /* number of bytes used in payload, 0 for an ACK */
+  char payload[MAXPAYLOAD];
 };
 
-/* send to A or B (int), packet to send */
-extern void tolayer3(int, struct pkt);  
+/* packets are passed by pointer and are reference counted, so a packet */
+/* is never copied on its way from sender to receiver.  allocpkt() gives */
+/* a new packet holding one reference; a packet is recycled when its    */
+/* last reference is released.  A packet that has been given to         */
+/* tolayer3() must not be modified any more - build a new one instead.  */
+/* A_input() and B_input() only borrow the packet they are given; hold */
+/* it to keep it after returning.                                        */
+extern struct pkt *allocpkt(void);
+extern struct pkt *holdpkt(struct pkt *);   /* take another reference */
+extern void releasepkt(struct pkt *);       /* drop a reference */
+extern struct pkt *copypkt(struct pkt *);   /* private copy, one reference */
+extern int *pktsends(struct pkt *);         /* times sent, kept by layer 3 */
+
+/* -M: where a packet in the channel goes, kept by layer 3.  With paths */
+/* the channel holds a private copy of each packet it carries, so every */
+/* trip has its own; without, these stay 0 and are never looked at.     */
+struct pktpath {
+  int path;                  /* path the packet takes */
+  float sent;                /* when A sent the packet this one is or answers */
+  int seq;                   /* and that packet's number on the path */
+};
+extern struct pktpath *pktpath(struct pkt *);
 
-/* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
+/* on the wire the header is packed into PKTHEADERBYTES bytes, in network */
+/* byte order: seqnum, acknum (signed) and length in 16 bits each, then   */
+/* the 32 bit checksum.  Sequence and block numbers, and the NOTINUSE,    */
+/* NAK and FEC_PARITY markers, all fit; a header field the channel        */
+/* corrupted may not, but is then cut to one that fails the checksum.     */
+/* The link rate (-r) counts these bytes as well.                         */
+#define PKTHEADERBYTES 10
+extern void pkt_pack(const struct pkt *, unsigned char *);
+extern void pkt_unpack(const unsigned char *, struct pkt *);
+
+/* send to A or B (int), packet to send.  Layer 3 takes its own */
+/* reference; the caller keeps (and must release) its own.      */
+extern void tolayer3(int, struct pkt *);  
+
+/* deliver to A or B (int), data to deliver, number of bytes */
+extern void tolayer5(int, char[], int); 
 
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
 /* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern void stoptimer(int);
+
+/* current simulated time, in time units since the start of the run */
+extern double get_sim_time(void);               
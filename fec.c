@@ -0,0 +1,286 @@
+/* ******************************************************************
+   XOR PARITY FORWARD ERROR CORRECTION
+
+   One parity packet per block of fec_block data packets lets the
+   receiver repair any single loss or corruption in the block, at the
+   cost of 1/k more packets.
+   - the sender folds each new packet into the parity as it is sent, so
+   nothing is kept but the running XOR
+   - the receiver keeps a reference to the latest uncorrupted packet for
+   each sequence number.  Block numbers tell a packet of the current
+   block from an older one with the same sequence number, and the
+   rebuilt packet must pass its checksum before it is handed back
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include "emulator.h"
+#include "checksum.h"
+#include "checkpoint.h"
+#include "fec.h"
+
+#define FEC_MAXSEQ 64               /* largest sequence space supported */
+
+int fec_block = 0;
+
+static int seqspace;
+
+/* sender: the parity of the block being sent */
+static int blocknum;                /* number of the current block */
+static int count;                   /* packets in it so far */
+static int first;                   /* seqnum of its first packet */
+static int xorlen, xorcksum;
+static int paritylen;               /* longest payload so far */
+static unsigned char parity[MAXPAYLOAD];
+
+/* receiver */
+static struct pkt *held[FEC_MAXSEQ];
+static int replayblock = -1;        /* block rebuilt last, for fec_replay() */
+
+/* statistics */
+static int datasent, paritysent, rebuilt, unrepairable;
+static long paritybytes;
+
+void fec_init(int n)
+{
+  int i;
+
+  /* a block must not wrap around the whole sequence space, or a rebuilt
+     packet could be taken for a later one with the same seqnum */
+  if (n > FEC_MAXSEQ || fec_block >= n) {
+    fprintf(stderr, "FEC: the block size can be at most %d with this protocol\n",
+            (n < FEC_MAXSEQ ? n : FEC_MAXSEQ) - 1);
+    exit(EXIT_FAILURE);
+  }
+  seqspace = n;
+  blocknum = 0;
+  count = 0;
+  for (i=0; i<FEC_MAXSEQ; i++)
+    if (held[i] != NULL) {
+      releasepkt(held[i]);
+      held[i] = NULL;
+    }
+  replayblock = -1;
+  datasent = paritysent = rebuilt = unrepairable = 0;
+  paritybytes = 0;
+}
+
+int fec_blocknum(void)
+{
+  return blocknum;
+}
+
+/* the parity header fields, 32 bits in network byte order */
+static void putfield(char *dst, int v)
+{
+  uint32_t n = htonl((uint32_t)v);
+
+  memcpy(dst, &n, 4);
+}
+
+static int getfield(const char *src)
+{
+  uint32_t n;
+
+  memcpy(&n, src, 4);
+  return (int)ntohl(n);
+}
+
+static void xorbytes(unsigned char *dst, const char *src, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    dst[i] ^= (unsigned char)src[i];
+}
+
+void fec_sent(struct pkt *p)
+{
+  struct pkt *q;
+
+  datasent++;
+  if (count == 0) {
+    first = p->seqnum;
+    xorlen = 0;
+    xorcksum = 0;
+    paritylen = 0;
+  }
+  if (p->length > paritylen) {
+    memset(parity + paritylen, 0, p->length - paritylen);
+    paritylen = p->length;
+  }
+  xorlen ^= p->length;
+  xorcksum ^= p->checksum;
+  xorbytes(parity, p->payload, p->length);
+  if (++count < fec_block)
+    return;
+
+  q = allocpkt();
+  q->seqnum = FEC_PARITY;
+  q->acknum = blocknum;
+  putfield(q->payload, first);
+  putfield(q->payload + 4, xorlen);
+  putfield(q->payload + 8, xorcksum);
+  memcpy(q->payload + FEC_HEADER, parity, paritylen);
+  q->length = FEC_HEADER + paritylen;
+  q->checksum = cksum_packet(q);
+  if (TRACE > 0)
+    printf("----A: block %d complete, sending parity packet\n", blocknum);
+  tolayer3(A, q);
+  releasepkt(q);
+  paritysent++;
+  paritybytes += q->length;
+  blocknum = (blocknum + 1) & 0x7fff;   /* fits the packed header's acknum */
+  count = 0;
+}
+
+int fec_isparity(struct pkt *p)
+{
+  return p->seqnum == FEC_PARITY;
+}
+
+void fec_received(struct pkt *p)
+{
+  if (p->seqnum < 0 || p->seqnum >= seqspace || held[p->seqnum] == p)
+    return;
+  if (held[p->seqnum] != NULL)
+    releasepkt(held[p->seqnum]);
+  held[p->seqnum] = holdpkt(p);
+}
+
+/* the kept packet with seqnum s, if it belongs to block b */
+static struct pkt *member(int s, int b)
+{
+  return (held[s] != NULL && held[s]->acknum == b) ? held[s] : NULL;
+}
+
+struct pkt *fec_recover(struct pkt *p)
+{
+  struct pkt *q, *r;
+  int start, len, cksum, missing = -1, i, s;
+
+  if (p->length < FEC_HEADER)
+    return NULL;
+  start = getfield(p->payload);
+  len = getfield(p->payload + 4);
+  cksum = getfield(p->payload + 8);
+  if (start < 0 || start >= seqspace)
+    return NULL;
+  for (i=0; i<fec_block; i++) {
+    s = (start + i) % seqspace;
+    if (member(s, p->acknum) == NULL) {
+      if (missing >= 0) {
+        if (TRACE > 0)
+          printf("----B: parity for block %d, more than one packet missing\n", p->acknum);
+        unrepairable++;
+        return NULL;
+      }
+      missing = s;
+    }
+  }
+  if (missing < 0)
+    return NULL;                    /* nothing to repair */
+
+  /* XOR the parity with every packet we have */
+  r = allocpkt();
+  memcpy(r->payload, p->payload + FEC_HEADER, p->length - FEC_HEADER);
+  for (i=0; i<fec_block; i++) {
+    s = (start + i) % seqspace;
+    if (s == missing)
+      continue;
+    q = member(s, p->acknum);
+    len ^= q->length;
+    cksum ^= q->checksum;
+    xorbytes((unsigned char *)r->payload, q->payload, q->length);
+  }
+  r->seqnum = missing;
+  r->acknum = p->acknum;
+  r->length = len;
+  r->checksum = cksum;
+  if (len < 0 || len > p->length - FEC_HEADER || cksum_packet(r) != cksum) {
+    if (TRACE > 0)
+      printf("----B: parity for block %d, rebuilt packet fails its checksum\n", p->acknum);
+    releasepkt(r);
+    unrepairable++;
+    return NULL;
+  }
+  if (TRACE > 0)
+    printf("----B: packet %d rebuilt from the parity of block %d\n", missing, p->acknum);
+  rebuilt++;
+  replayblock = p->acknum;
+  return r;
+}
+
+struct pkt *fec_replay(int seqnum)
+{
+  if (replayblock < 0 || seqnum < 0 || seqnum >= seqspace)
+    return NULL;
+  return member(seqnum, replayblock);
+}
+
+/* the block numbers only label the blocks for the receiver, which sees
+   the same labels whether or not a stretch was skipped */
+unsigned long fec_state(void)
+{
+  int i, n = 0;
+
+  if (fec_block <= 0)
+    return 0;
+  for (i=0; i<seqspace; i++)
+    if (held[i] != NULL)
+      n++;
+  return ((unsigned long)count * FEC_MAXSEQ + first) * (FEC_MAXSEQ + 1) + n;
+}
+
+void fec_counts(long *c)
+{
+  c[0] = datasent;
+  c[1] = paritysent;
+  c[2] = paritybytes;
+}
+
+void fec_repeat(const long *delta, long times)
+{
+  datasent += delta[0] * times;
+  paritysent += delta[1] * times;
+  paritybytes += delta[2] * times;
+}
+
+void fec_report(void)
+{
+  if (fec_block <= 0)
+    return;
+  printf("FEC (blocks of %d):  %d parity packets sent, %ld bytes (%.1f%% more packets), %d packets rebuilt, %d blocks beyond repair \n",
+         fec_block, paritysent, paritybytes,
+         datasent ? 100.0 * paritysent / datasent : 0.0, rebuilt, unrepairable);
+}
+
+void fec_checkpoint(void)
+{
+  int i;
+
+  ckpt_tag("fec");
+  CKPT(fec_block);
+  CKPT(seqspace);                   /* -x is not given again on resume */
+  if (seqspace < 0 || seqspace > FEC_MAXSEQ) {
+    fprintf(stderr, "checkpoint: bad FEC sequence space %d\n", seqspace);
+    exit(EXIT_FAILURE);
+  }
+  CKPT(blocknum);
+  CKPT(count);
+  CKPT(first);
+  CKPT(xorlen);
+  CKPT(xorcksum);
+  CKPT(paritylen);
+  ckpt_data(parity, paritylen);
+  for (i=0; i<FEC_MAXSEQ; i++)
+    ckpt_pkt(&held[i]);
+  CKPT(replayblock);
+  CKPT(datasent);
+  CKPT(paritysent);
+  CKPT(rebuilt);
+  CKPT(unrepairable);
+  CKPT(paritybytes);
+}
@@ -0,0 +1,57 @@
+/* forward error correction with XOR parity, shared by GBN and SR (-F k). */
+/* After every k new data packets the sender sends one parity packet, the */
+/* XOR of their lengths, checksums and payloads.  If exactly one packet   */
+/* of a block is lost or corrupted, the receiver rebuilds it from the     */
+/* others and the parity, without waiting for a retransmission.           */
+/*                                                                        */
+/* Data packets carry their block number in acknum (unused otherwise).    */
+/* A parity packet has seqnum FEC_PARITY, its block number in acknum, and */
+/* a FEC_HEADER byte header (first seqnum of the block, XOR of lengths,   */
+/* XOR of checksums, each 32 bits in network byte order like the packet   */
+/* header on the wire) in front of the XOR of the payloads.               */
+
+#define FEC_PARITY  (-3)
+#define FEC_HEADER  12
+
+/* block size k, 0 when FEC is off */
+extern int fec_block;
+
+/* reset both ends; the protocol's sequence space bounds the block size */
+extern void fec_init(int);
+
+/* sender: block number to put in the acknum of the next new packet */
+extern int fec_blocknum(void);
+
+/* sender: a new data packet has gone to layer 3; sends the parity */
+/* packet when it completes a block                               */
+extern void fec_sent(struct pkt *);
+
+/* receiver: non zero for a parity packet */
+extern int fec_isparity(struct pkt *);
+
+/* receiver: keep an uncorrupted data packet for rebuilding its block */
+extern void fec_received(struct pkt *);
+
+/* receiver: given a parity packet, the rebuilt packet (one reference,  */
+/* to be released by the caller) if exactly one of its block is missing */
+extern struct pkt *fec_recover(struct pkt *);
+
+/* receiver: the packet with this seqnum if it belongs to the block just */
+/* rebuilt, so a receiver that drops out of order packets can take them */
+/* now; NULL otherwise                                                   */
+extern struct pkt *fec_replay(int);
+
+/* hybrid mode (-H -H): a number that tells apart the states of the   */
+/* current block that behave differently (but not its block number),  */
+/* the counts of the packets sent so far (FEC_NCOUNTS of them), and   */
+/* adding the counts of a stretch the given number of times           */
+#define FEC_NCOUNTS 3
+extern unsigned long fec_state(void);
+extern void fec_counts(long *);
+extern void fec_repeat(const long *, long);
+
+/* print overhead and repair counts */
+extern void fec_report(void);
+
+/* save or restore the FEC state in a checkpoint (checkpoint.h) */
+extern void fec_checkpoint(void);
@@ -0,0 +1,255 @@
+/* ******************************************************************
+   FILE TRANSFER WORKLOAD
+
+   Replaces the emulator's repeated letters with the contents of a real
+   file (-f), so a transfer can be checked end to end and timed.
+   - the input file is mmap'd read only, so there is no read() into a
+   staging buffer: each MTU sized piece is copied once, from the mapping
+   into the message handed to layer 4
+   - data delivered at B is collected in a large staging buffer and
+   written to the output file (-o) with writev(): the staging buffer and
+   the piece that no longer fits go out in a single system call
+   - both streams are hashed with CRC-32C (hardware accelerated where
+   available) and compared, together with their lengths, at the end
+   - throughput is reported in bytes per simulated time unit and in
+   bytes per second of wall clock time
+   ********************************************************************* */
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "emulator.h"
+#include "checksum.h"
+#include "checkpoint.h"
+#include "filexfer.h"
+
+#define SINKBYTES (4 * 1048576)     /* staging buffer for the output file */
+
+static int active = 0;
+static char inpath[4096], outpath[4096];  /* kept for checkpoints */
+static unsigned char *src;          /* the mapped input file */
+static long srcsize;                /* its size in bytes */
+static long srcoff;                 /* bytes handed to layer 4 so far */
+
+static int sinkfd = -1;             /* output file, -1 to only hash */
+static char *sink;                  /* staging buffer */
+static long sinkused;               /* bytes waiting in the staging buffer */
+static long delivered;              /* bytes delivered at B */
+static unsigned int dsthash;        /* running CRC-32C of delivered data */
+static struct timespec started;
+static long startdelivered;         /* delivered when the clock started */
+
+static void fatal(const char *what, const char *name)
+{
+  fprintf(stderr, "file transfer: %s %s: %s\n", what, name, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+/* map the input, open the output (truncated unless resuming) */
+static void openfiles(const char *in, const char *out, int truncate)
+{
+  struct stat st;
+  int fd;
+
+  fd = open(in, O_RDONLY);
+  if (fd < 0)
+    fatal("cannot open", in);
+  if (fstat(fd, &st) < 0)
+    fatal("cannot stat", in);
+  srcsize = st.st_size;
+  src = NULL;
+  if (srcsize > 0) {
+    src = mmap(NULL, srcsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (src == MAP_FAILED)
+      fatal("cannot map", in);
+    madvise(src, srcsize, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  srcoff = 0;
+
+  if (in != inpath)
+    snprintf(inpath, sizeof(inpath), "%s", in);
+  if (out == NULL)
+    outpath[0] = '\0';
+  else {
+    sinkfd = open(out, O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (sinkfd < 0)
+      fatal("cannot create", out);
+    if (out != outpath)
+      snprintf(outpath, sizeof(outpath), "%s", out);
+  }
+  sink = malloc(SINKBYTES);
+  if (sink == 0) {
+    printf("memory allocation for output buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  sinkused = 0;
+  delivered = 0;
+  dsthash = 0xffffffff;
+  startdelivered = 0;
+  active = 1;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+void xfer_open(const char *in, const char *out)
+{
+  openfiles(in, out, 1);
+}
+
+int xfer_active(void)
+{
+  return active;
+}
+
+long xfer_remaining(void)
+{
+  return srcsize - srcoff;
+}
+
+int xfer_next(char *buf, int max)
+{
+  int n;
+
+  n = (srcsize - srcoff < max) ? (int)(srcsize - srcoff) : max;
+  memcpy(buf, src + srcoff, n);
+  srcoff += n;
+  return n;
+}
+
+void xfer_unread(int n)
+{
+  srcoff -= n;
+}
+
+/* write iov[0..cnt-1] completely, coping with short writes */
+static void writeall(struct iovec *iov, int cnt)
+{
+  ssize_t n;
+
+  while (cnt > 0) {
+    n = writev(sinkfd, iov, cnt);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fatal("cannot write", "output file");
+    }
+    while (cnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+void xfer_deliver(char *data, int length)
+{
+  struct iovec iov[2];
+
+  dsthash = crc32c_update(dsthash, (unsigned char *)data, length);
+  delivered += length;
+  if (sinkfd < 0)
+    return;
+  if (sinkused + length <= SINKBYTES) {
+    memcpy(sink + sinkused, data, length);
+    sinkused += length;
+    return;
+  }
+  /* staging buffer is full: write it and this piece together */
+  iov[0].iov_base = sink;
+  iov[0].iov_len = sinkused;
+  iov[1].iov_base = data;
+  iov[1].iov_len = length;
+  writeall(iov, 2);
+  sinkused = 0;
+}
+
+/* write out the staging buffer */
+static void flushsink(void)
+{
+  struct iovec iov;
+
+  iov.iov_base = sink;
+  iov.iov_len = sinkused;
+  writeall(&iov, 1);
+  sinkused = 0;
+}
+
+void xfer_checkpoint(void)
+{
+  long size;
+
+  ckpt_tag("file transfer");
+  CKPT(active);
+  if (!active)
+    return;
+  if (!ckpt_restoring() && sinkfd >= 0)
+    flushsink();
+  ckpt_string(inpath, sizeof(inpath));
+  ckpt_string(outpath, sizeof(outpath));
+  size = srcsize;
+  CKPT(size);
+  if (ckpt_restoring()) {
+    openfiles(inpath, outpath[0] ? outpath : NULL, 0);
+    if (size != srcsize) {
+      fprintf(stderr, "file transfer: %s has changed size since the checkpoint\n", inpath);
+      exit(EXIT_FAILURE);
+    }
+  }
+  CKPT(srcoff);
+  CKPT(delivered);
+  CKPT(dsthash);
+  if (ckpt_restoring()) {
+    startdelivered = delivered;
+    if (sinkfd >= 0 && (ftruncate(sinkfd, delivered) < 0 || lseek(sinkfd, delivered, SEEK_SET) < 0))
+      fatal("cannot position", outpath);
+  }
+}
+
+void xfer_report(double simtime)
+{
+  struct timespec now;
+  unsigned int srchash;
+  long off, n;
+  double secs;
+
+  if (sinkfd >= 0) {
+    flushsink();
+    if (close(sinkfd) < 0)
+      fatal("cannot close", "output file");
+    sinkfd = -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+
+  srchash = 0xffffffff;
+  for (off = 0; off < srcsize; off += n) {
+    n = (srcsize - off < SINKBYTES) ? srcsize - off : SINKBYTES;
+    srchash = crc32c_update(srchash, src + off, n);
+  }
+
+  printf("file transfer:  %ld of %ld bytes delivered, crc32c sent %08x received %08x: %s \n",
+         delivered, srcsize, ~srchash, ~dsthash,
+         (delivered == srcsize && srchash == dsthash) ? "VERIFIED" : "MISMATCH");
+  if (simtime > 0.0)
+    printf("file transfer:  %f bytes per time unit \n", delivered / simtime);
+  if (secs > 0.0)
+    printf("file transfer:  %.3f s wall clock, %.0f bytes/sec \n", secs,
+           (delivered - startdelivered) / secs);
+  if (src != NULL)
+    munmap(src, srcsize);
+  free(sink);
+  active = 0;
+}
@@ -0,0 +1,31 @@
+/* file transfer workload: layer 5 at A streams a file into A_output() */
+/* and layer 5 at B writes what it is given to an output file.  At the */
+/* end the CRC-32C of both streams is compared.                        */
+
+/* map the input file and open the output file (may be NULL) */
+extern void xfer_open(const char *, const char *);
+
+/* non zero once xfer_open() has been called */
+extern int xfer_active(void);
+
+/* number of input bytes not yet handed to layer 4 */
+extern long xfer_remaining(void);
+
+/* copy up to max bytes of input into buf, returns the number copied */
+extern int xfer_next(char *, int);
+
+/* push back the last n bytes taken with xfer_next(), because the      */
+/* sender refused them (window full) and they must be offered again    */
+extern void xfer_unread(int);
+
+/* layer 5 at B: append delivered data to the output stream */
+extern void xfer_deliver(char *, int);
+
+/* save or restore the transfer in a checkpoint (checkpoint.h).  The  */
+/* output written so far is flushed on save; on restore both files    */
+/* are opened again and the output is cut back to the bytes delivered */
+extern void xfer_checkpoint(void);
+
+/* flush the output, compare the streams and print the results, */
+/* given the simulated time at the end of the run              */
+extern void xfer_report(double);
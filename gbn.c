@@ -3,6 +3,10 @@
 #include <stdbool.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "checksum.h"
+#include "checkpoint.h"
+#include "fec.h"
+#include "cwnd.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,6 +24,22 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - optional XOR parity FEC (-F k, see fec.c); a rebuilt packet lets B
+   also take the rest of its block, which it had dropped as out of order
+   - optional congestion window (-W, see cwnd.c).  After a timeout or a
+   third duplicate ACK A goes back to the first unACKed packet but only
+   resends as much of the window as cwnd allows, and the rest as ACKs
+   open it again
+   - the window (-x, with a sequence space of one more) and the timeout
+   (-t) can be chosen at run time, e.g. by the tuner (-T)
+   - A_idle(), A_fastforward() and B_fastforward() let the emulator's
+   hybrid mode (-H) skip packets sent and ACKed while nothing else is
+   in flight; A_state() and B_state() let it (-H -H) find a stretch of
+   a full window that repeats itself
+   - when the channel can reorder packets (several paths, -M) B keeps
+   the packets that arrive ahead of the one it expects, in a reorder
+   buffer like SR's, and delivers and ACKs them once the gap is filled.
+   The sequence space is then twice the window, as for SR
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
@@ -27,28 +47,44 @@
                           MUST BE SET TO 6 when submitting assignment */
 #define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define MAXWINDOW 32    /* largest window that can be chosen at run time (-x) */
+
+/* the window, sequence space and timeout actually used: the values above
+   unless -x or -t choose others (window_size, rtt_timeout) */
+static int windowsize, seqspace;
+static double rtt;
+
+/* the protocol, for the result cache key (cache.h) */
+const char protocol_name[] = "gbn";
+
+static void setsizes(void)
+{
+  if (window_size > MAXWINDOW) {
+    fprintf(stderr, "the window can be at most %d packets\n", MAXWINDOW);
+    exit(EXIT_FAILURE);
+  }
+  windowsize = (window_size > 0) ? window_size : WINDOWSIZE;
+  seqspace = (window_size > 0) ? windowsize + 1 : SEQSPACE;
+  /* with a reorder buffer B must tell early packets from old ones */
+  if (reordering)
+    seqspace = 2 * windowsize;
+  rtt = (rtt_timeout > 0.0) ? rtt_timeout : RTT;
+}
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
+   the packet is corrupted.  The algorithm is the one selected with -k (CRC-32C by
+   default), see checksum.c.
 */
-int ComputeChecksum(struct pkt packet)
+int ComputeChecksum(struct pkt *packet)
 {
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  return cksum_packet(packet);
 }
 
-bool IsCorrupted(struct pkt packet)
+bool IsCorrupted(struct pkt *packet)
 {
-  if (packet.checksum == ComputeChecksum(packet))
+  if (packet->checksum == ComputeChecksum(packet))
     return (false);
   else
     return (true);
@@ -57,46 +93,68 @@ bool IsCorrupted(struct pkt packet)
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+static struct pkt *buffer[MAXWINDOW]; /* array for storing packets waiting for ACK */
 static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
 static int windowcount;                /* the number of packets currently awaiting an ACK */
 static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+static int windowsent;                 /* packets at the front of the window sent since going back */
+
+/* (re)send the packets of the window that cwnd allows but that have not
+   been sent since A last went back to the first unACKed packet */
+static void A_sendmore(void)
+{
+  struct pkt *p;
+
+  while (windowsent < windowcount && windowsent < cwnd_window()) {
+    p = buffer[(windowfirst + windowsent) % windowsize];
+    if (TRACE > 0)
+      printf ("---A: resending packet %d\n", p->seqnum);
+    tolayer3(A, p);
+    packets_resent++;
+    windowsent++;
+  }
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+void A_output(struct msg *message)
 {
-  struct pkt sendpkt;
+  struct pkt *sendpkt;
   int i;
 
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
+  if ( windowcount < cwnd_window()) {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
     /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
+    sendpkt = allocpkt();
+    sendpkt->seqnum = A_nextseqnum;
+    sendpkt->acknum = (fec_block > 0) ? fec_blocknum() : NOTINUSE;
+    sendpkt->length = message->length;
+    for ( i=0; i<message->length ; i++ )
+      sendpkt->payload[i] = message->data[i];
+    sendpkt->checksum = ComputeChecksum(sendpkt);
+
+    /* put packet in window buffer, the window owns this reference */
     /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
+    windowlast = (windowlast + 1) % windowsize;
     buffer[windowlast] = sendpkt;
     windowcount++;
 
     /* send out packet */
     if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+      printf("Sending packet %d to layer 3\n", sendpkt->seqnum);
     tolayer3 (A, sendpkt);
+    windowsent++;
+    if (fec_block > 0)
+      fec_sent(sendpkt);
 
     /* start timer if first packet in window */
     if (windowcount == 1)
-      starttimer(A,RTT);
+      starttimer(A,rtt);
 
     /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    A_nextseqnum = (A_nextseqnum + 1) % seqspace;
   }
   /* if blocked,  window is full */
   else {
@@ -110,7 +168,7 @@ void A_output(struct msg message)
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
-void A_input(struct pkt packet)
+void A_input(struct pkt *packet)
 {
   int ackcount = 0;
   int i;
@@ -118,41 +176,60 @@ void A_input(struct pkt packet)
   /* if received ACK is not corrupted */
   if (!IsCorrupted(packet)) {
     if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
+      printf("----A: uncorrupted ACK %d is received\n",packet->acknum);
     total_ACKs_received++;
 
     /* check if new ACK or duplicate */
     if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
+          /* the window's sequence numbers are consecutive, so its ends
+             follow from A_nextseqnum without touching the packets */
+          int seqfirst = (A_nextseqnum - windowcount + seqspace) % seqspace;
+          int seqlast = (A_nextseqnum - 1 + seqspace) % seqspace;
           /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
+          if (((seqfirst <= seqlast) && (packet->acknum >= seqfirst && packet->acknum <= seqlast)) ||
+              ((seqfirst > seqlast) && (packet->acknum >= seqfirst || packet->acknum <= seqlast))) {
 
             /* packet is a new ACK */
             if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
+              printf("----A: ACK %d is not a duplicate\n",packet->acknum);
             new_ACKs++;
 
             /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
+            if (packet->acknum >= seqfirst)
+              ackcount = packet->acknum + 1 - seqfirst;
             else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
-
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
+              ackcount = seqspace - seqfirst + packet->acknum;
 
             /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
+            for (i=0; i<ackcount; i++) {
+              releasepkt(buffer[(windowfirst + i) % windowsize]);
+              buffer[(windowfirst + i) % windowsize] = NULL;
               windowcount--;
+            }
+
+	    /* slide window by the number of packets ACKed */
+            windowfirst = (windowfirst + ackcount) % windowsize;
+            windowsent = (windowsent > ackcount) ? windowsent - ackcount : 0;
+
+            /* a larger window may let more of the resent packets go */
+            cwnd_acked(ackcount);
+            A_sendmore();
 
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
             if (windowcount > 0)
-              starttimer(A, RTT);
+              starttimer(A, rtt);
 
           }
+          /* a duplicate ACK: on the third, cut the window and go back now */
+          else if (cwnd_dupack()) {
+            if (TRACE > 0)
+              printf("----A: third duplicate ACK %d, go back to packet %d\n", packet->acknum, seqfirst);
+            windowsent = 0;
+            A_sendmore();
+            stoptimer(A);
+            starttimer(A, rtt);
+          }
         }
         else
           if (TRACE > 0)
@@ -166,20 +243,15 @@ void A_input(struct pkt packet)
 /* called when A's timer goes off */
 void A_timerinterrupt(void)
 {
-  int i;
-
   if (TRACE > 0)
     printf("----A: time out,resend packets!\n");
 
-  for(i=0; i<windowcount; i++) {
-
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
-
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
-  }
+  /* go back to the first unACKed packet, as far as the window allows */
+  cwnd_timeout();
+  windowsent = 0;
+  A_sendmore();
+  if (windowcount > 0)
+    starttimer(A,rtt);
 }
 
 
@@ -189,6 +261,8 @@ void A_timerinterrupt(void)
 void A_init(void)
 {
   /* initialise A's window, buffer and sequence number */
+  int i;
+  setsizes();
   A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
   windowfirst = 0;
   windowlast = -1;   /* windowlast is where the last packet sent is stored.
@@ -196,6 +270,55 @@ void A_init(void)
 		     so initially this is set to -1
 		   */
   windowcount = 0;
+  windowsent = 0;
+  for (i = 0; i < windowsize; i++)
+    buffer[i] = NULL;
+  fec_init(seqspace);
+  cwnd_init(windowsize);
+}
+
+/* -H: nothing is in flight when the window is empty */
+double A_idle(void)
+{
+  return (windowcount == 0) ? rtt : 0.0;
+}
+
+/* -H: a packet was sent from the empty window and ACKed */
+void A_fastforward(void)
+{
+  windowlast = (windowlast + 1) % windowsize;
+  windowfirst = (windowfirst + 1) % windowsize;
+  A_nextseqnum = (A_nextseqnum + 1) % seqspace;
+  total_ACKs_received++;
+  new_ACKs++;
+}
+
+/* -H -H: where the window is and how much of it has been sent */
+unsigned long A_state(void)
+{
+  return ((unsigned long)A_nextseqnum * (MAXWINDOW + 1) + windowcount) * (MAXWINDOW + 1) + windowsent;
+}
+
+/* save or restore A's state; the window holds one reference to each packet */
+void A_checkpoint(void)
+{
+  int i;
+
+  ckpt_tag("gbn A");
+  CKPT(windowsize);
+  CKPT(seqspace);
+  CKPT(rtt);
+  if (windowsize < 1 || windowsize > MAXWINDOW || seqspace <= windowsize) {
+    fprintf(stderr, "checkpoint: bad window size %d\n", windowsize);
+    exit(EXIT_FAILURE);
+  }
+  CKPT(windowfirst);
+  CKPT(windowlast);
+  CKPT(windowcount);
+  CKPT(A_nextseqnum);
+  CKPT(windowsent);
+  for (i = 0; i < windowsize; i++)
+    ckpt_pkt(&buffer[i]);
 }
 
 
@@ -204,60 +327,135 @@ void A_init(void)
 
 static int expectedseqnum; /* the sequence number expected next by the receiver */
 static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static struct pkt *recvbuf[MAXWINDOW]; /* -M: held packets that arrived early */
 
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+void B_input(struct pkt *packet)
 {
-  struct pkt sendpkt;
-  int i;
+  struct pkt *sendpkt, *fixed, *held;
+
+  /* FEC: keep the packet for its block, or repair the block with a parity packet */
+  if (fec_block > 0 && !IsCorrupted(packet)) {
+    if (fec_isparity(packet)) {
+      fixed = fec_recover(packet);
+      if (fixed != NULL) {
+        B_input(fixed);
+        releasepkt(fixed);
+        /* the rest of the block was dropped as out of order: take it now */
+        while ((fixed = fec_replay(expectedseqnum)) != NULL)
+          B_input(fixed);
+      }
+      return;
+    }
+    fec_received(packet);
+  }
 
   /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
+  sendpkt = allocpkt();
+
+  if  ( (!IsCorrupted(packet))  && (packet->seqnum == expectedseqnum) ) {
     if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+      printf("----B: packet %d is correctly received, send ACK!\n",packet->seqnum);
     packets_received++;
 
     /* deliver to receiving application */
-    tolayer5(B, packet.payload);
+    tolayer5(B, packet->payload, packet->length);
 
     /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    sendpkt->acknum = expectedseqnum;
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    expectedseqnum = (expectedseqnum + 1) % seqspace;
+
+    /* packets that overtook this one follow it now, ACKed together */
+    while (recvbuf[expectedseqnum % windowsize] != NULL) {
+      held = recvbuf[expectedseqnum % windowsize];
+      recvbuf[expectedseqnum % windowsize] = NULL;
+      tolayer5(B, held->payload, held->length);
+      releasepkt(held);
+      sendpkt->acknum = expectedseqnum;
+      expectedseqnum = (expectedseqnum + 1) % seqspace;
+    }
   }
   else {
+    /* an early packet is held until the ones before it arrive */
+    if (reordering && !IsCorrupted(packet) &&
+        (packet->seqnum - expectedseqnum + seqspace) % seqspace < windowsize &&
+        recvbuf[packet->seqnum % windowsize] == NULL) {
+      if (TRACE > 0)
+        printf("----B: packet %d arrived early, hold it\n", packet->seqnum);
+      packets_received++;
+      recvbuf[packet->seqnum % windowsize] = holdpkt(packet);
+    }
     /* packet is corrupted or out of order resend last ACK */
     if (TRACE > 0)
       printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
     if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
+      sendpkt->acknum = seqspace - 1;
     else
-      sendpkt.acknum = expectedseqnum - 1;
+      sendpkt->acknum = expectedseqnum - 1;
   }
 
   /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
+  sendpkt->seqnum = B_nextseqnum;
   B_nextseqnum = (B_nextseqnum + 1) % 2;
 
-  /* we don't have any data to send.  fill payload with 0's */
-  for ( i=0; i<20 ; i++ )
-    sendpkt.payload[i] = '0';
+  /* we don't have any data to send, the ACK has no payload */
+  sendpkt->length = 0;
 
   /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt);
+  sendpkt->checksum = ComputeChecksum(sendpkt);
 
-  /* send out packet */
+  /* send out packet, layer 3 keeps its own reference */
   tolayer3 (B, sendpkt);
+  releasepkt(sendpkt);
 }
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
+  int i;
+
+  setsizes();
   expectedseqnum = 0;
   B_nextseqnum = 1;
+  for (i = 0; i < windowsize; i++)
+    recvbuf[i] = NULL;
+}
+
+/* -H: the expected packet arrived and was ACKed */
+void B_fastforward(void)
+{
+  packets_received++;
+  expectedseqnum = (expectedseqnum + 1) % seqspace;
+  B_nextseqnum = (B_nextseqnum + 1) % 2;
+}
+
+/* -H -H: the packet expected, the ACK's alternating seqnum and which of
+   the packets after it are held (-M) */
+unsigned long B_state(void)
+{
+  unsigned long held = 0;
+  int i;
+
+  for (i = 0; reordering && i < windowsize; i++)
+    if (recvbuf[(expectedseqnum + i) % windowsize] != NULL)
+      held |= 1ul << i;
+  return (held * seqspace + expectedseqnum) * 2 + B_nextseqnum;
+}
+
+/* save or restore B's state */
+void B_checkpoint(void)
+{
+  int i;
+
+  ckpt_tag("gbn B");
+  CKPT(expectedseqnum);
+  CKPT(B_nextseqnum);
+  for (i = 0; i < windowsize; i++)
+    ckpt_pkt(&recvbuf[i]);
 }
 
 /******************************************************************************
@@ -265,7 +463,7 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+void B_output(struct msg *message)
 {
 }
 
@@ -0,0 +1,172 @@
+/* ******************************************************************
+   DELIVERY LATENCY
+
+   Times layer 5 data through the protocol, so changes to recovery (NAKs,
+   FEC, congestion control) can be judged on tail latency and not only
+   on goodput.
+   - send times of accepted but undelivered segments wait in a ring
+   that grows with the window
+   - latencies go into a histogram with LAT_RES buckets per time unit up
+   to LAT_LIMIT; the exact maximum and mean are kept as well, so long
+   runs need no memory per message
+   - the last LAT_RECENT latencies are kept as well, so a stretch that
+   the emulator's hybrid mode repeats in bulk can repeat its latencies
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "checkpoint.h"
+#include "latency.h"
+
+#define LAT_RES     8               /* buckets per time unit */
+#define LAT_LIMIT   4096            /* time units covered by the buckets */
+#define LAT_BUCKETS (LAT_RES * LAT_LIMIT + 1)   /* last one: beyond the limit */
+
+static double *pending;             /* ring of send times */
+static int npending, firstpending, maxpending;
+
+static long hist[LAT_BUCKETS];
+static long count;
+static double sum, max;
+static double recent[LAT_RECENT];   /* the latest latencies, nrecent in all */
+static long nrecent;
+
+void lat_sent(double t)
+{
+  double *p;
+  int i;
+
+  if (npending == maxpending) {
+    maxpending = maxpending ? 2 * maxpending : 64;
+    p = malloc(maxpending * sizeof(double));
+    if (p == 0) {
+      printf("memory allocation for latency measurement failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i=0; i<npending; i++)
+      p[i] = pending[(firstpending + i) % (maxpending / 2)];
+    free(pending);
+    pending = p;
+    firstpending = 0;
+  }
+  pending[(firstpending + npending) % maxpending] = t;
+  npending++;
+}
+
+static long bucket(double l)
+{
+  long b = (long)(l * LAT_RES);
+
+  if (b < 0)
+    b = 0;
+  if (b >= LAT_BUCKETS)
+    b = LAT_BUCKETS - 1;
+  return b;
+}
+
+void lat_delivered(double t)
+{
+  double l;
+
+  if (npending == 0)
+    return;                         /* delivered more than was sent */
+  l = t - pending[firstpending];
+  firstpending = (firstpending + 1) % maxpending;
+  npending--;
+
+  hist[bucket(l)]++;
+  recent[nrecent++ % LAT_RECENT] = l;
+  count++;
+  sum += l;
+  if (l > max)
+    max = l;
+}
+
+long lat_count(void)
+{
+  return count;
+}
+
+void lat_shift(double dt)
+{
+  int i;
+
+  for (i=0; i<npending; i++)
+    pending[(firstpending + i) % maxpending] += dt;
+}
+
+void lat_repeat(long n, long times)
+{
+  double l;
+  long i;
+
+  if (n > LAT_RECENT || n > nrecent)
+    n = (nrecent < LAT_RECENT) ? nrecent : LAT_RECENT;
+  for (i=nrecent - n; i<nrecent; i++) {
+    l = recent[i % LAT_RECENT];
+    hist[bucket(l)] += times;
+    sum += l * times;
+  }
+  count += n * times;
+}
+
+/* upper edge of the bucket holding the given fraction of the samples */
+double lat_percentile(double fraction)
+{
+  long seen = 0, want;
+  int b;
+
+  if (count == 0)
+    return 0.0;
+  want = (long)(fraction * count);
+  if (want < 1)
+    want = 1;
+  for (b=0; b<LAT_BUCKETS - 1; b++) {
+    seen += hist[b];
+    if (seen >= want)
+      return (double)(b + 1) / LAT_RES;
+  }
+  return max;
+}
+
+double lat_mean(void)
+{
+  return count ? sum / count : 0.0;
+}
+
+void lat_report(void)
+{
+  if (count == 0)
+    return;
+  printf("delivery latency:  mean %f  p50 %.3f  p99 %.3f  p99.9 %.3f  max %f (%ld segments) \n",
+         sum / count, lat_percentile(0.5), lat_percentile(0.99), lat_percentile(0.999), max, count);
+}
+
+void lat_checkpoint(void)
+{
+  double t;
+  int i, n;
+
+  ckpt_tag("latency");
+  n = npending;
+  CKPT(n);
+  for (i=0; i<n; i++) {
+    if (!ckpt_restoring())
+      t = pending[(firstpending + i) % maxpending];
+    CKPT(t);
+    if (ckpt_restoring())
+      lat_sent(t);
+  }
+  CKPT(count);
+  CKPT(sum);
+  CKPT(max);
+  /* only the buckets up to the highest one in use */
+  for (n=LAT_BUCKETS; n>0 && hist[n - 1] == 0; n--)
+    ;
+  CKPT(n);
+  if (n < 0 || n > LAT_BUCKETS) {
+    fprintf(stderr, "checkpoint: bad latency histogram\n");
+    exit(EXIT_FAILURE);
+  }
+  ckpt_data(hist, n * sizeof(long));
+}
@@ -0,0 +1,33 @@
+/* delivery latency of layer 5 data: the simulated time from A_output() */
+/* accepting a segment until layer 5 at B receives it.  Both protocols  */
+/* deliver in order, so the oldest outstanding segment is always the    */
+/* one being delivered.                                                 */
+
+/* a segment was accepted by the sender at the given time */
+extern void lat_sent(double);
+
+/* the oldest outstanding segment was delivered at the given time */
+extern void lat_delivered(double);
+
+/* mean latency so far, 0 before anything is delivered */
+extern double lat_mean(void);
+
+/* latency below which the given fraction of the segments were delivered */
+extern double lat_percentile(double);
+
+/* segments delivered so far */
+extern long lat_count(void);
+
+/* hybrid mode (-H -H): a steady stretch was advanced in bulk.  The send */
+/* times still waiting move on by the given time, and the latencies of  */
+/* the last n segments delivered (at most LAT_RECENT) count again, the  */
+/* given number of times                                                */
+#define LAT_RECENT 4096
+extern void lat_shift(double);
+extern void lat_repeat(long, long);
+
+/* print mean, median, tail and maximum latency */
+extern void lat_report(void);
+
+/* save or restore the measurements in a checkpoint (checkpoint.h) */
+extern void lat_checkpoint(void);
@@ -0,0 +1,232 @@
+/* ******************************************************************
+   MULTIPATH CHANNEL
+
+   Several parallel links between A and B, so a sender is no longer held
+   to the throughput of one FIFO channel.
+   - each path is a channel of its own in tolayer3(): its own queue,
+   delay scale and loss probability
+   - B answers on the path a packet came in on and the event carries
+   the packet's send time back to A, like a TCP timestamp echo, so A
+   gets one RTT sample per ACK and per path, resends included
+   - -S rtt weights the paths by (1 - loss) / srtt and picks them with
+   smooth weighted round robin (as in nginx): deterministic, no random
+   draws, and every path with some weight keeps getting probes
+   - A numbers the packets it sends on each path and B echoes the
+   number too.  A path is FIFO both ways, so an answer to packet n
+   means that the packets sent before it and still unanswered, or
+   their answers, were lost.  The loss seen is a moving average of
+   that, over roughly the last MP_MEMORY packets
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "checkpoint.h"
+#include "multipath.h"
+
+#define MP_MEMORY   32              /* packets the loss estimate looks back over */
+#define MP_MAXLOSS  0.9             /* a path never loses all its weight */
+#define MP_GAIN     0.125           /* of a new RTT sample, as in TCP */
+
+static int npaths;
+static int weighted;                /* -S rtt */
+static char spec[256];
+static double scale[MP_MAXPATHS];
+static float loss[MP_MAXPATHS];     /* below 0: the loss entered at start up */
+
+/* A's view of each path */
+static double srtt[MP_MAXPATHS];
+static double seen[MP_MAXPATHS];    /* moving average of the loss */
+static int answered[MP_MAXPATHS];   /* number of the last packet answered */
+static double credit[MP_MAXPATHS];  /* weighted round robin */
+static int nextrr;
+
+/* statistics */
+static int sent[MP_MAXPATHS], resent[MP_MAXPATHS], lost[MP_MAXPATHS];
+static int acks[MP_MAXPATHS], ackslost[MP_MAXPATHS];
+static long bytes[MP_MAXPATHS];
+
+int mp_open(const char *s)
+{
+  char *end;
+  int n = 0;
+
+  snprintf(spec, sizeof(spec), "%s", s);
+  while (n < MP_MAXPATHS) {
+    scale[n] = strtod(s, &end);
+    if (end == s || scale[n] <= 0.0)
+      return -1;
+    loss[n] = -1.0;
+    s = end;
+    if (*s == ':') {
+      loss[n] = strtod(s + 1, &end);
+      if (end == s + 1 || loss[n] < 0.0 || loss[n] > 1.0)
+        return -1;
+      s = end;
+    }
+    n++;
+    if (*s == '\0') {
+      npaths = n;
+      mp_init();
+      return n;
+    }
+    if (*s++ != ',')
+      return -1;
+  }
+  return -1;
+}
+
+int mp_policy(const char *s)
+{
+  if (strcmp(s, "rr") == 0)
+    weighted = 0;
+  else if (strcmp(s, "rtt") == 0)
+    weighted = 1;
+  else
+    return -1;
+  return 0;
+}
+
+int mp_paths(void)
+{
+  return npaths;
+}
+
+void mp_init(void)
+{
+  int p;
+
+  for (p=0; p<npaths; p++) {
+    srtt[p] = 2 * 5.5 * scale[p];   /* the mean round trip of an idle path */
+    seen[p] = credit[p] = 0.0;
+    answered[p] = 0;
+    sent[p] = resent[p] = lost[p] = acks[p] = ackslost[p] = 0;
+    bytes[p] = 0;
+  }
+  nextrr = 0;
+}
+
+static double seenloss(int p)
+{
+  return seen[p] > MP_MAXLOSS ? MP_MAXLOSS : seen[p];
+}
+
+int mp_choose(void)
+{
+  double total = 0.0;
+  int p, best = 0;
+
+  if (!weighted) {
+    p = nextrr;
+    nextrr = (nextrr + 1) % npaths;
+    return p;
+  }
+  for (p=0; p<npaths; p++) {
+    credit[p] += (1.0 - seenloss(p)) / srtt[p];
+    total += (1.0 - seenloss(p)) / srtt[p];
+    if (credit[p] > credit[best])
+      best = p;
+  }
+  credit[best] -= total;
+  return best;
+}
+
+double mp_scale(int p)
+{
+  return scale[p];
+}
+
+float mp_loss(int p)
+{
+  return loss[p];
+}
+
+int mp_sent(int p, int AorB, int resend)
+{
+  if (AorB != A)
+    return 0;
+  if (resend)
+    resent[p]++;
+  return ++sent[p];
+}
+
+void mp_lost(int p, int AorB)
+{
+  if (AorB == A)
+    lost[p]++;
+  else
+    ackslost[p]++;
+}
+
+void mp_arrived(int p, int length)
+{
+  bytes[p] += length;
+}
+
+void mp_acked(int p, double rtt, int n)
+{
+  acks[p]++;
+  srtt[p] += MP_GAIN * (rtt - srtt[p]);
+  if (n <= answered[p])
+    return;                         /* a second answer, e.g. a NAK */
+  while (++answered[p] < n)
+    seen[p] += (1.0 - seen[p]) / MP_MEMORY;
+  seen[p] -= seen[p] / MP_MEMORY;
+}
+
+const char *mp_name(void)
+{
+  static char name[300];
+
+  if (npaths == 0)
+    return "none";
+  snprintf(name, sizeof(name), "%s %s", spec, weighted ? "rtt" : "rr");
+  return name;
+}
+
+void mp_report(long delivered, double time)
+{
+  int p;
+
+  if (npaths == 0)
+    return;
+  printf("multipath:  %d paths, striped %s \n", npaths, weighted ? "by RTT and loss" : "round robin");
+  for (p=0; p<npaths; p++) {
+    printf("  path %d (delay x%g, ", p, scale[p]);
+    if (loss[p] < 0.0)
+      printf("loss as entered):  ");
+    else
+      printf("loss %g):  ", loss[p]);
+    printf("%d packets sent, %d resent, %d lost, %ld bytes reached B (%f per time unit), "
+           "%d ACKs back, %d lost, srtt %f, loss seen %.3f \n",
+           sent[p], resent[p], lost[p], bytes[p], time > 0.0 ? bytes[p] / time : 0.0,
+           acks[p], ackslost[p], srtt[p], seenloss(p));
+  }
+  printf("aggregate goodput over %d paths:  %f bytes per time unit \n",
+         npaths, time > 0.0 ? delivered / time : 0.0);
+}
+
+void mp_checkpoint(void)
+{
+  ckpt_tag("multipath");
+  CKPT(npaths);
+  CKPT(weighted);
+  ckpt_string(spec, sizeof(spec));
+  if (npaths < 0 || npaths > MP_MAXPATHS) {
+    fprintf(stderr, "checkpoint: bad number of paths %d\n", npaths);
+    exit(EXIT_FAILURE);
+  }
+  CKPT(scale);
+  CKPT(loss);
+  CKPT(srtt);
+  CKPT(seen);
+  CKPT(answered);
+  CKPT(credit);
+  CKPT(nextrr);
+  CKPT(sent);
+  CKPT(resent);
+  CKPT(lost);
+  CKPT(acks);
+  CKPT(ackslost);
+  CKPT(bytes);
+}
@@ -0,0 +1,58 @@
+/* multipath channel (-M): K parallel paths between A and B instead of   */
+/* one, each with its own delay and loss.  A stripes its packets across */
+/* the paths (-S rr: round robin, -S rtt: weighted by the RTT and loss  */
+/* it measures on each path); B answers on the path the packet came in  */
+/* on and echoes its send time, so A can time every path.  Packets on   */
+/* one path stay in order, but can be overtaken by a faster path.       */
+/*                                                                      */
+/* A path is given as scale[:loss]: its delay is scale times the usual  */
+/* 1 to 10 time units, and its loss probability the one given, or the   */
+/* one entered at start up.  Paths are separated by commas, e.g.        */
+/*   -M 1,1,3:0.2                                                       */
+
+#define MP_MAXPATHS 16
+
+/* parse the paths; returns their number, or -1 if the spec is bad */
+extern int mp_open(const char *);
+
+/* striping policy, rr or rtt; returns -1 if unknown */
+extern int mp_policy(const char *);
+
+/* number of paths, 0 when there is just the usual channel */
+extern int mp_paths(void);
+
+/* forget the measurements and statistics, for a new run */
+extern void mp_init(void);
+
+/* the path for A's next packet */
+extern int mp_choose(void);
+
+/* delay scale of a path */
+extern double mp_scale(int);
+
+/* loss probability of a path, below 0 to use the one entered */
+extern float mp_loss(int);
+
+/* a packet went out on a path from A or B; resend is non zero for a  */
+/* packet A has sent before.  Returns the number of A's packet on the */
+/* path, which B's answer echoes                                      */
+extern int mp_sent(int, int, int);
+
+/* a packet from A or B was lost on a path */
+extern void mp_lost(int, int);
+
+/* a packet with this many bytes of payload reached B on a path */
+extern void mp_arrived(int, int);
+
+/* an ACK or NAK reached A on a path, this long after its packet was */
+/* sent, and echoing that packet's number                            */
+extern void mp_acked(int, double, int);
+
+/* paths and policy in one line, for the result cache key */
+extern const char *mp_name(void);
+
+/* print per path statistics and the aggregate goodput over time units */
+extern void mp_report(long, double);
+
+/* save or restore the paths in a checkpoint (checkpoint.h) */
+extern void mp_checkpoint(void);
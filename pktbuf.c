@@ -0,0 +1,135 @@
+/* ******************************************************************
+   PACKET BUFFERS
+
+   Reference counted packet buffers, shared by the emulator, the UDP
+   backend and the protocols.  A packet is built once by the sender and
+   then passed by pointer: the sender's window, the event list (or the
+   socket layer) and the receiver all hold references to the same
+   buffer.  Only a packet the channel corrupts is copied first, so the
+   sender's copy in its window stays intact.
+
+   Released buffers are kept on a free list and reused, so steady state
+   traffic does not call malloc() or free() at all.
+
+   pkt_pack() and pkt_unpack() convert the header to and from the packed
+   form the UDP backend puts on the wire.
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "emulator.h"
+
+struct pktbuf {
+  int refcount;               /* number of holders, 0 while on the free list */
+  int sends;                  /* times given to layer 3 */
+  struct pktpath path;        /* -M: this trip through the channel */
+  struct pktbuf *nextfree;    /* free list link */
+  struct pkt pkt;             /* the packet handed out to the caller */
+};
+
+/* recover the buffer from the packet pointer handed out by allocpkt() */
+#define PKTBUF(p) ((struct pktbuf *)((char *)(p) - offsetof(struct pktbuf, pkt)))
+
+static struct pktbuf *freelist = NULL;
+
+struct pkt *allocpkt(void)
+{
+  struct pktbuf *b;
+
+  if (freelist != NULL) {
+    b = freelist;
+    freelist = b->nextfree;
+  }
+  else {
+    b = malloc(sizeof(struct pktbuf));
+    if (b == 0) {
+      printf("memory allocation for packet failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  b->refcount = 1;
+  b->sends = 0;
+  b->path.path = b->path.seq = 0;
+  b->path.sent = 0.0;
+  b->nextfree = NULL;
+  b->pkt.length = 0;
+  return &b->pkt;
+}
+
+struct pkt *holdpkt(struct pkt *p)
+{
+  PKTBUF(p)->refcount++;
+  return p;
+}
+
+void releasepkt(struct pkt *p)
+{
+  struct pktbuf *b = PKTBUF(p);
+
+  if (b->refcount <= 0) {
+    printf("INTERNAL PANIC: packet released more often than it was held\n");
+    exit(EXIT_FAILURE);
+  }
+  if (--b->refcount == 0) {
+    b->nextfree = freelist;
+    freelist = b;
+  }
+}
+
+int *pktsends(struct pkt *p)
+{
+  return &PKTBUF(p)->sends;
+}
+
+struct pktpath *pktpath(struct pkt *p)
+{
+  return &PKTBUF(p)->path;
+}
+
+/* copy the header and the used part of the payload into a new buffer */
+struct pkt *copypkt(struct pkt *p)
+{
+  struct pkt *q;
+  int i;
+
+  q = allocpkt();
+  q->seqnum = p->seqnum;
+  q->acknum = p->acknum;
+  q->checksum = p->checksum;
+  q->length = p->length;
+  for (i=0; i<p->length; i++)
+    q->payload[i] = p->payload[i];
+  return q;
+}
+
+/* the header in its packed wire form, PKTHEADERBYTES long */
+void pkt_pack(const struct pkt *p, unsigned char *w)
+{
+  uint16_t s = htons((uint16_t)p->seqnum);
+  uint16_t a = htons((uint16_t)p->acknum);
+  uint16_t l = htons((uint16_t)p->length);
+  uint32_t c = htonl((uint32_t)p->checksum);
+
+  memcpy(w, &s, 2);
+  memcpy(w + 2, &a, 2);
+  memcpy(w + 4, &l, 2);
+  memcpy(w + 6, &c, 4);
+}
+
+void pkt_unpack(const unsigned char *w, struct pkt *p)
+{
+  uint16_t s, a, l;
+  uint32_t c;
+
+  memcpy(&s, w, 2);
+  memcpy(&a, w + 2, 2);
+  memcpy(&l, w + 4, 2);
+  memcpy(&c, w + 6, 4);
+  p->seqnum = (int16_t)ntohs(s);
+  p->acknum = (int16_t)ntohs(a);
+  p->length = ntohs(l);
+  p->checksum = (int)ntohl(c);
+}
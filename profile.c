@@ -0,0 +1,353 @@
+/* ******************************************************************
+   EVENT LOOP PROFILER
+
+   Lightweight instrumentation for emulator.c, switched on with -p.
+   - every profiled region (an event type being handled, or one of the
+   emulator routines the protocols call) pushes itself on a small stack
+   on entry and pops on exit.  Inclusive and self (minus nested regions)
+   cycles and call counts are kept per region, and self cycles per
+   distinct stack, which is what a folded stack file needs
+   - time is read with rdtsc on x86 and clock_gettime() elsewhere; the
+   tick rate is calibrated against CLOCK_MONOTONIC over the whole run so
+   the table can show nanoseconds
+   - the event list length is sampled every PROF_SAMPLE_EVERY events
+   The cost of the protocol handlers (including their trace output) is
+   the self time of the event type region they run under.
+
+   The -B run statistics used by bench.sh live here as well, since this
+   is where the clocks are.  On Linux they include the L1 data cache
+   read misses and last level cache misses of the run, per ACK received
+   too, counted in user space with perf_event_open(); they are null when
+   the kernel or the machine (e.g. a VM) has no such counters.
+   ********************************************************************* */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE                /* syscall() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "profile.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define TICKNAME "cycles"
+static uint64_t ticks(void)
+{
+  return __rdtsc();
+}
+#else
+#define TICKNAME "ns"
+static uint64_t ticks(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+#define PROF_MAXDEPTH     15        /* regions nest at most this deep */
+#define PROF_PATHS      1024        /* distinct stacks kept (power of 2) */
+#define PROF_SAMPLE_EVERY 64        /* events between event list samples */
+
+static const char *regionname[PROF_NREGIONS] = {
+  "timer_interrupt", "from_layer5", "from_layer3", "insertevent",
+  "starttimer", "stoptimer", "tolayer3", "tolayer5",
+  "generate_next_arrival", "trace_output"
+};
+
+int prof_enabled = 0;
+
+static char prefix[256];
+static uint64_t starttick, startns;
+static uint64_t benchns;              /* -B: wall clock at the start */
+
+/* per region totals */
+static long calls[PROF_NREGIONS];
+static uint64_t incl[PROF_NREGIONS], self[PROF_NREGIONS];
+
+/* the current stack: region, entry tick, ticks spent in nested regions */
+static int depth;
+static int stack[PROF_MAXDEPTH];
+static uint64_t entered[PROF_MAXDEPTH], nested[PROF_MAXDEPTH];
+static uint64_t pathcode[PROF_MAXDEPTH + 1];  /* stack encoded 4 bits per level */
+static int overflow;                          /* enters beyond PROF_MAXDEPTH */
+static uint64_t rootnested;                   /* ticks inside any region */
+
+/* self ticks per distinct stack, open addressed on the path code */
+static uint64_t pathkey[PROF_PATHS], pathticks[PROF_PATHS];
+
+/* event list samples */
+static double *sampletime;
+static int *samplelen;
+static long nsamples, maxsamples, nevents;
+
+static uint64_t nsnow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void prof_start(const char *name)
+{
+  snprintf(prefix, sizeof(prefix), "%s", name);
+  memset(calls, 0, sizeof(calls));
+  memset(incl, 0, sizeof(incl));
+  memset(self, 0, sizeof(self));
+  memset(pathkey, 0, sizeof(pathkey));
+  memset(pathticks, 0, sizeof(pathticks));
+  depth = 0;
+  overflow = 0;
+  pathcode[0] = 0;
+  rootnested = 0;
+  nsamples = nevents = 0;
+  maxsamples = 0;
+  sampletime = NULL;
+  samplelen = NULL;
+  prof_enabled = 1;
+  startns = nsnow();
+  starttick = ticks();
+}
+
+void prof_enter(int r)
+{
+  if (depth == PROF_MAXDEPTH) {
+    overflow++;
+    return;
+  }
+  stack[depth] = r;
+  nested[depth] = 0;
+  pathcode[depth + 1] = (pathcode[depth] << 4) | (uint64_t)(r + 1);
+  depth++;
+  entered[depth - 1] = ticks();
+}
+
+static void addpath(uint64_t code, uint64_t t)
+{
+  unsigned int h = (unsigned int)((code * 0x9e3779b97f4a7c15ULL) >> 54) & (PROF_PATHS - 1);
+
+  while (pathkey[h] != 0 && pathkey[h] != code)
+    h = (h + 1) & (PROF_PATHS - 1);
+  pathkey[h] = code;
+  pathticks[h] += t;
+}
+
+void prof_exit(int r)
+{
+  uint64_t t, s;
+
+  t = ticks();
+  if (overflow > 0) {
+    overflow--;
+    return;
+  }
+  if (depth == 0 || stack[depth - 1] != r) {
+    fprintf(stderr, "profiler: unbalanced exit from %s\n", regionname[r]);
+    prof_enabled = 0;
+    return;
+  }
+  depth--;
+  t -= entered[depth];
+  s = t - nested[depth];
+  calls[r]++;
+  incl[r] += t;
+  self[r] += s;
+  addpath(pathcode[depth + 1], s);
+  if (depth > 0)
+    nested[depth - 1] += t;
+  else
+    rootnested += t;
+}
+
+void prof_sample(double simtime, int length)
+{
+  if (nevents++ % PROF_SAMPLE_EVERY != 0)
+    return;
+  if (nsamples == maxsamples) {
+    maxsamples = maxsamples ? 2 * maxsamples : 4096;
+    sampletime = realloc(sampletime, maxsamples * sizeof(double));
+    samplelen = realloc(samplelen, maxsamples * sizeof(int));
+    if (sampletime == 0 || samplelen == 0) {
+      printf("memory allocation for profile samples failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  sampletime[nsamples] = simtime;
+  samplelen[nsamples] = length;
+  nsamples++;
+}
+
+/* write one folded stack line: emulator;region;region... ticks */
+static void writepath(FILE *fp, uint64_t code, uint64_t t)
+{
+  int regions[16], n = 0;
+
+  while (code != 0 && n < 16) {
+    regions[n++] = (int)(code & 0xf) - 1;
+    code >>= 4;
+  }
+  fprintf(fp, "emulator");
+  while (n > 0)
+    fprintf(fp, ";%s", regionname[regions[--n]]);
+  fprintf(fp, " %llu\n", (unsigned long long)t);
+}
+
+void prof_report(void)
+{
+  uint64_t totalticks, totalns, rootself;
+  double nspertick, evsum = 0.0;
+  char path[300];
+  FILE *fp;
+  long i;
+  int r, evmin = 0, evmax = 0;
+
+  totalticks = ticks() - starttick;
+  totalns = nsnow() - startns;
+  prof_enabled = 0;
+  nspertick = totalticks ? (double)totalns / totalticks : 0.0;
+  rootself = totalticks - rootnested;
+
+  printf("\n--- profile (%llu %s, %.3f ms, %ld events) ---\n",
+         (unsigned long long)totalticks, TICKNAME, totalns / 1e6, nevents);
+  printf("%-22s %10s %12s %12s %10s %7s\n",
+         "region", "calls", "incl ms", "self ms", "ns/call", "self %");
+  for (r=0; r<PROF_NREGIONS; r++) {
+    if (calls[r] == 0)
+      continue;
+    printf("%-22s %10ld %12.3f %12.3f %10.1f %6.1f%%\n", regionname[r], calls[r],
+           incl[r] * nspertick / 1e6, self[r] * nspertick / 1e6,
+           incl[r] * nspertick / calls[r],
+           totalticks ? 100.0 * self[r] / totalticks : 0.0);
+  }
+  printf("%-22s %10s %12s %12.3f %10s %6.1f%%\n", "emulator (main loop)", "",
+         "", rootself * nspertick / 1e6, "",
+         totalticks ? 100.0 * rootself / totalticks : 0.0);
+
+  if (nsamples > 0) {
+    evmin = evmax = samplelen[0];
+    for (i=0; i<nsamples; i++) {
+      evsum += samplelen[i];
+      if (samplelen[i] < evmin)
+        evmin = samplelen[i];
+      if (samplelen[i] > evmax)
+        evmax = samplelen[i];
+    }
+    printf("event list length:  min %d  mean %.2f  max %d  (%ld samples, every %d events)\n",
+           evmin, evsum / nsamples, evmax, nsamples, PROF_SAMPLE_EVERY);
+  }
+
+  snprintf(path, sizeof(path), "%s.folded", prefix);
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    return;
+  }
+  if (rootself > 0)
+    fprintf(fp, "emulator %llu\n", (unsigned long long)rootself);
+  for (i=0; i<PROF_PATHS; i++)
+    if (pathkey[i] != 0)
+      writepath(fp, pathkey[i], pathticks[i]);
+  fclose(fp);
+  printf("folded stacks (%s) written to %s\n", TICKNAME, path);
+
+  snprintf(path, sizeof(path), "%s.evlist", prefix);
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    return;
+  }
+  fprintf(fp, "# simulated time, event list length\n");
+  for (i=0; i<nsamples; i++)
+    fprintf(fp, "%f %d\n", sampletime[i], samplelen[i]);
+  fclose(fp);
+  printf("event list samples written to %s\n", path);
+  free(sampletime);
+  free(samplelen);
+}
+
+/* -B hardware counters: L1 data cache read misses, last level misses */
+#define BENCH_L1D  0
+#define BENCH_LLC  1
+static int counterfd[2] = { -1, -1 };
+
+static void opencounters(void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  int i;
+
+  for (i=0; i<2; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    if (i == BENCH_L1D) {
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+    else {
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;          /* allowed without privileges */
+    attr.exclude_hv = 1;
+    counterfd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (counterfd[i] >= 0)
+      ioctl(counterfd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+/* print "name": count, "name_per_ack": count per ACK, or nulls */
+static void printcounter(const char *name, int i, long acks)
+{
+  uint64_t n = 0;
+
+#ifdef __linux__
+  if (counterfd[i] >= 0 && read(counterfd[i], &n, sizeof(n)) != sizeof(n)) {
+    close(counterfd[i]);
+    counterfd[i] = -1;
+  }
+#endif
+  if (counterfd[i] < 0)
+    printf(", \"%s\": null, \"%s_per_ack\": null", name, name);
+  else
+    printf(", \"%s\": %llu, \"%s_per_ack\": %.2f", name, (unsigned long long)n,
+           name, acks ? (double)n / acks : 0.0);
+}
+
+void prof_bench_start(void)
+{
+  opencounters();
+  benchns = nsnow();
+}
+
+void prof_bench_report(long events, double simtime, long bytes, long acks)
+{
+  struct rusage ru;
+  uint64_t wall;
+
+  wall = nsnow() - benchns;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    ru.ru_maxrss = 0;
+  printf("BENCH {\"events\": %ld, \"wall_ns\": %llu, \"ns_per_event\": %.2f, "
+         "\"events_per_sec\": %.0f, \"peak_rss_kb\": %ld, \"sim_time\": %.3f, "
+         "\"bytes_delivered\": %ld, \"goodput\": %.6f, \"acks\": %ld",
+         events, (unsigned long long)wall,
+         events ? (double)wall / events : 0.0,
+         wall ? events * 1e9 / wall : 0.0,
+         (long)ru.ru_maxrss, simtime, bytes,
+         simtime > 0.0 ? bytes / simtime : 0.0, acks);
+  printcounter("l1d_misses", BENCH_L1D, acks);
+  printcounter("cache_misses", BENCH_LLC, acks);
+  printf("}\n");
+}
@@ -0,0 +1,43 @@
+/* hot path profiler for the emulator's event loop (-p prefix).  Counts */
+/* calls and cycles per event type and per emulator routine, samples   */
+/* the event list length, and writes a table to stdout plus            */
+/* prefix.folded (flamegraph.pl input) and prefix.evlist at the end.   */
+
+/* profiled regions.  The first three match the emulator's event codes */
+#define PROF_TIMER_INTERRUPT  0
+#define PROF_FROM_LAYER5      1
+#define PROF_FROM_LAYER3      2
+#define PROF_INSERTEVENT      3
+#define PROF_STARTTIMER       4
+#define PROF_STOPTIMER        5
+#define PROF_TOLAYER3         6
+#define PROF_TOLAYER5         7
+#define PROF_GENERATE         8   /* generate_next_arrival() */
+#define PROF_TRACE            9   /* event trace output in the main loop */
+#define PROF_NREGIONS        10
+
+extern int prof_enabled;
+
+/* the macros cost one predictable branch when profiling is off */
+#define PROF_ENTER(r)  do { if (prof_enabled) prof_enter(r); } while (0)
+#define PROF_EXIT(r)   do { if (prof_enabled) prof_exit(r); } while (0)
+#define PROF_SAMPLE(t, n) do { if (prof_enabled) prof_sample(t, n); } while (0)
+
+/* start profiling, output files are named after the prefix */
+extern void prof_start(const char *);
+extern void prof_enter(int);
+extern void prof_exit(int);
+
+/* called once per event with the simulated time and event list length */
+extern void prof_sample(double, int);
+
+/* stop profiling, print the table and write the files */
+extern void prof_report(void);
+
+/* -B: start the wall clock and cache miss counters, and at the end  */
+/* print one line                                                    */
+/*   BENCH {"events": ..., "wall_ns": ..., "peak_rss_kb": ..., ...}   */
+/* given the events simulated, simulated time, bytes delivered and    */
+/* ACKs received at A                                                 */
+extern void prof_bench_start(void);
+extern void prof_bench_report(long, double, long, long);
@@ -0,0 +1,337 @@
+#!/bin/sh
+# Regression tests for the emulator, both protocols and the UDP backend.
+#
+#   ./regress.sh       build everything and run every check
+#   ./regress.sh -u    the same, but first rewrite the known-good reports
+#
+# Both protocols are built from source into $BUILDDIR (default _regress)
+# with $CC $CFLAGS (default cc -O2), once on the emulator and once on the
+# UDP backend.  Every scenario is run with both protocols and its end of
+# run report compared with the known-good one in regress/, named after
+# the protocol and the scenario.  The reports leave out the prompts and
+# the checksum implementation, which depends on the CPU.  The other
+# checks compare two runs with each other, or a run with what it is
+# expected to do, and need no known-good report.  Every check prints ok
+# or FAIL and its name, and the exit status is non zero if any failed.
+#
+# Only change the known-good reports (-u) for a commit that means to
+# change what the emulator or a protocol does, and say so in it.
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+BUILDDIR=${BUILDDIR:-_regress}
+SRCS="emulator.c pktbuf.c checksum.c filexfer.c traffic.c profile.c checkpoint.c latency.c fec.c cwnd.c runner.c tune.c replicate.c cache.c multipath.c"
+UDPSRCS="udpnet.c pktbuf.c checksum.c traffic.c checkpoint.c fec.c cwnd.c"
+# name messages loss corruption lambda options; -P runs replicas in
+# rounds of one per job, so where it stops depends on -j
+SCENARIOS="
+clean    500  0   0   8
+lossy    1000 0.2 0.2 10
+slow     200  0.1 0.3 5
+segments 300  0.2 0.2 10 -m 64 -s 150
+mtu1000  300  0.1 0   10 -m 1000
+poisson  300  0.1 0.1 20 -a poisson
+onoff    300  0.1 0.1 20 -a onoff
+trace    200  0.1 0.1 20 -a trace:regress/arrivals.trace
+nak      1000 0.2 0.1 10 -N
+fec      1000 0.2 0.1 10 -F 3
+cwnd     1000 0.2 0.1 10 -W
+window   1000 0.2 0.1 10 -x 16 -t 30
+tune     200  0.1 0.1 20 -T goodput
+replicas 300  0.2 0.2 10 -P 0.1 -j 2
+multirr  1000 0.1 0.1 10 -M 1,1,3:0.2
+multirtt 1000 0.1 0.1 10 -M 1,1,3:0.2 -S rtt
+window32 2000 0.1 0   1  -x 32 -t 40 -W
+wide     1000 0.2 0.1 10 -x 32 -t 40 -N -F 3
+"
+
+UPDATE=
+while getopts "u" opt; do
+  case $opt in
+    u) UPDATE=1 ;;
+    *) echo "usage: $0 [-u]" >&2; exit 2 ;;
+  esac
+done
+
+cd "$(dirname "$0")" || exit 1
+mkdir -p "$BUILDDIR" regress || exit 1
+for p in gbn sr; do
+  echo "building $BUILDDIR/$p and $BUILDDIR/${p}_udp" >&2
+  $CC $CFLAGS -o "$BUILDDIR/$p" $SRCS $p.c -lm || exit 1
+  $CC $CFLAGS -o "$BUILDDIR/${p}_udp" $UDPSRCS $p.c -lm || exit 1
+done
+# SR with a sequence space of three windows, so packets that -M delays
+# by more than a window arrive outside both of B's windows
+echo "building $BUILDDIR/sr_seq18" >&2
+$CC $CFLAGS -DSEQSPACE=18 -o "$BUILDDIR/sr_seq18" $SRCS sr.c -lm || exit 1
+echo "building $BUILDDIR/cksumbench" >&2
+$CC $CFLAGS -o "$BUILDDIR/cksumbench" cksumbench.c checksum.c || exit 1
+
+failures=0
+pass() {
+  echo "ok   $1"
+}
+fail() {
+  echo "FAIL $1"
+  failures=$((failures + 1))
+}
+
+# the answers to the start up prompts
+answers() {
+  if [ "$2" = 0 ] && [ "$3" = 0 ]; then
+    printf "$1\n$2\n$3\n$4\n0\n"
+  else
+    printf "$1\n$2\n$3\n2\n$4\n0\n"
+  fi
+}
+
+# the end of run report, without the prompts in front of its first line,
+# the checksum implementation and the number of jobs
+report() {
+  awk '!p && match($0, /(Simulator|Backend) terminated|^tuning |^replicating /) { p = 1; $0 = substr($0, RSTART) }
+       /^checksum:/ { sub(/ \(.*\)/, "") }
+       /^(tuning|replicating) / { sub(/, [0-9]+ jobs?$/, "") }
+       p'
+}
+
+# run program messages loss corruption lambda options...: the report
+run() {
+  prog=$1
+  args="$2 $3 $4 $5"
+  shift 5
+  answers $args | "$BUILDDIR/$prog" "$@" 2>&1 | report
+}
+
+# golden name file: compare a report with its known-good one
+golden() {
+  if [ -n "$UPDATE" ]; then
+    cp "$2" "regress/$1.txt"
+  fi
+  if cmp -s "$2" "regress/$1.txt"; then
+    pass "$1"
+  else
+    fail "$1"
+    diff "regress/$1.txt" "$2" | head -n 10
+  fi
+}
+
+# same name file1 file2: two runs that must report the same
+same() {
+  if cmp -s "$2" "$3"; then
+    pass "$1"
+  else
+    fail "$1"
+    diff "$2" "$3" | head -n 10
+  fi
+}
+
+# field file pattern: the number after pattern in a report
+field() {
+  sed -n "s/.*$2 *\([0-9.]*\).*/\1/p" "$1" | head -n 1
+}
+
+out=$BUILDDIR/out
+for p in gbn sr; do
+  while read -r name msgs loss corrupt lambda opts; do
+    [ -z "$name" ] && continue
+    run $p $msgs $loss $corrupt $lambda $opts > $out.$p.$name
+    golden $p-$name $out.$p.$name
+  done <<EOF
+$SCENARIOS
+EOF
+done
+
+# the channel corrupts a copy of the packet, never the buffer the sender
+# keeps in its window to resend: with half the packets corrupted a file
+# still arrives whole, on the usual channel and over several paths
+for p in gbn sr; do
+  for opts in "" "-M 1,1"; do
+    name=$p-corrupt-copy$(echo $opts | tr -d ' ')
+    rm -f $out.file
+    run $p 100 0 0.5 10 -f emulator.h -m 200 -o $out.file $opts > $out.filexfer
+    if grep -q 'VERIFIED' $out.filexfer && cmp -s emulator.h $out.file; then
+      pass $name
+    else
+      fail $name
+    fi
+  done
+done
+
+# B answers a packet outside both of its windows with its last in order
+# ACK, not with whatever acknum the recycled ACK buffer held
+run sr_seq18 2000 0.2 0.2 5 -M 1,8:0 > $out.seq18
+golden sr-seq18 $out.seq18
+
+# every checksum catches every corruption the emulator makes, so the
+# choice of algorithm only shows in the checksum line; cksumbench checks
+# each implementation against the scalar one of its algorithm
+for p in gbn sr; do
+  run $p 1000 0.2 0.2 10 -k crc32c | grep -v '^checksum:' > $out.crc32c
+  for k in sum inet; do
+    run $p 1000 0.2 0.2 10 -k $k | grep -v '^checksum:' > $out.$k
+    same $p-checksum-$k $out.crc32c $out.$k
+  done
+done
+if "$BUILDDIR/cksumbench" 1 > $out.cksumbench; then
+  pass cksumbench
+else
+  fail cksumbench
+fi
+
+# a file sent over a lossy channel arrives whole
+for p in gbn sr; do
+  rm -f $out.file
+  run $p 100 0.2 0.2 10 -f emulator.h -m 200 -o $out.file > $out.filexfer
+  if grep -q 'VERIFIED' $out.filexfer && cmp -s emulator.h $out.file; then
+    pass $p-filexfer
+  else
+    fail $p-filexfer
+  fi
+done
+
+# profiling leaves the run as it was and writes both of its files
+for p in gbn sr; do
+  rm -f $out.prof.folded $out.prof.evlist
+  run $p 300 0.1 0.1 20 > $out.plain.$p
+  run $p 300 0.1 0.1 20 -p $out.prof | sed '/^--- profile/,$d' | grep -v '^$' > $out.profiled
+  if [ -s $out.prof.folded ] && [ -s $out.prof.evlist ]; then
+    same $p-profile $out.plain.$p $out.profiled
+  else
+    fail $p-profile
+  fi
+done
+
+# so does measuring it for bench.sh, which adds one BENCH line
+for p in gbn sr; do
+  run $p 300 0.1 0.1 20 -B > $out.bench
+  grep -v '^BENCH {' $out.bench > $out.measured
+  if [ "$(grep -c '^BENCH {' $out.bench)" = 1 ]; then
+    same $p-bench $out.plain.$p $out.measured
+  else
+    fail $p-bench
+  fi
+done
+
+# a run resumed from its last checkpoint ends as the run did
+for p in gbn sr; do
+  for opts in "" "-F 3" "-W" "-x 16 -t 30" "-M 1,3"; do
+    name=$p-resume$(echo $opts | tr -d ' ')
+    rm -f $out.ckpt
+    run $p 2000 0.1 0.1 20 $opts > $out.full
+    run $p 2000 0.1 0.1 20 $opts -C $out.ckpt -i 5000 > /dev/null
+    "$BUILDDIR/$p" -R $out.ckpt 2>&1 | report > $out.resumed
+    if [ -s $out.ckpt ]; then
+      same $name $out.full $out.resumed
+    else
+      fail $name
+    fi
+  done
+done
+
+# replicas found in the result cache report what running them did, and
+# a changed arrival trace is a different simulation point
+for p in gbn sr; do
+  rm -rf $out.cache
+  run $p 300 0.2 0.2 10 -P 0.1 -j 2 -K $out.cache > /dev/null
+  run $p 300 0.2 0.2 10 -P 0.1 -j 2 -K $out.cache > $out.cached
+  grep -v '^result cache' $out.cached > $out.hits
+  if grep -q '^result cache .* 0 misses' $out.cached; then
+    same $p-cache-hits $out.$p.replicas $out.hits
+  else
+    fail $p-cache-hits
+  fi
+  cp regress/arrivals.trace $out.trace
+  run $p 200 0.1 0.1 20 -a trace:$out.trace -P 0.1 -j 2 -K $out.cache > /dev/null
+  echo 5000 >> $out.trace
+  run $p 200 0.1 0.1 20 -a trace:$out.trace -P 0.1 -j 2 -K $out.cache > $out.cached
+  if grep -q '^result cache .* 0 hits' $out.cached; then
+    pass $p-cache-trace
+  else
+    fail $p-cache-trace
+  fi
+done
+
+# -H only takes shortcuts the full simulation would have taken: the
+# report is the same apart from the line counting them, which must not
+# be zero for the check to mean anything
+for p in gbn sr; do
+  for opts in "" "-N" "-x 16 -t 30"; do
+    name=$p-hybrid$(echo $opts | tr -d ' ')
+    run $p 2000 0.1 0.1 20 $opts > $out.full
+    run $p 2000 0.1 0.1 20 $opts -H > $out.hybrid
+    grep -v '^hybrid mode:' $out.hybrid > $out.shortcut
+    if [ "$(field $out.hybrid 'hybrid mode:')" -gt 0 ] 2>/dev/null; then
+      same $name $out.full $out.shortcut
+    else
+      fail $name
+    fi
+  done
+done
+
+# near a b: b is within 5% of a
+near() {
+  awk -v a="$1" -v b="$2" 'BEGIN { exit !(a > 0 && b > 0.95 * a && b < 1.05 * a) }'
+}
+
+# -H -H is not the same run, but without loss it delivers about as many
+# messages as fast as the full simulation, having repeated some of the
+# steady state in bulk.  Checkpoints start its search again, so a run
+# resumed with it ends as the run that saved the checkpoint did
+for p in gbn sr; do
+  for opts in "-t 60" "-x 16 -t 200"; do
+    name=$p-hybrid2$(echo $opts | tr -d ' ')
+    run $p 20000 0 0 5 $opts > $out.full
+    run $p 20000 0 0 5 $opts -H -H > $out.hybrid
+    if [ "$(field $out.hybrid 'fast-forwarded,')" -gt 0 ] 2>/dev/null &&
+       near "$(field $out.full 'delivered to application:')" \
+            "$(field $out.hybrid 'delivered to application:')" &&
+       near "$(field $out.full 'bytes delivered.*(')" \
+            "$(field $out.hybrid 'bytes delivered.*(')"; then
+      pass $name
+    else
+      fail $name
+    fi
+  done
+  rm -f $out.ckpt
+  run $p 4000 0.0005 0.0005 5 -t 60 -H -H -C $out.ckpt -i 2000 > $out.full
+  "$BUILDDIR/$p" -R $out.ckpt 2>&1 | report > $out.resumed
+  if [ -s $out.ckpt ] && [ "$(field $out.full 'fast-forwarded,')" -gt 0 ] 2>/dev/null; then
+    same $p-resume-hybrid2 $out.full $out.resumed
+  else
+    fail $p-resume-hybrid2
+  fi
+done
+
+# the UDP backend runs in real time, so only what cannot depend on the
+# timing is checked: without loss every message gets through, with it
+# some do, with a batch size of one every packet is sent on its own, and
+# the parity packets of a wide window get through the wire header
+for p in gbn sr; do
+  run ${p}_udp 200 0 0 20 > $out.udp
+  if [ "$(field $out.udp 'delivered to application:')" = 200 ]; then
+    pass ${p}_udp-clean
+  else
+    fail ${p}_udp-clean
+  fi
+  run ${p}_udp 200 0.2 0.2 20 > $out.udp
+  if [ "$(field $out.udp 'delivered to application:')" -gt 0 ] 2>/dev/null; then
+    pass ${p}_udp-lossy
+  else
+    fail ${p}_udp-lossy
+  fi
+  run ${p}_udp 200 0 0 20 -b 1 > $out.udp
+  if [ "$(field $out.udp 'delivered to application:')" = 200 ] &&
+     [ "$(field $out.udp 'sendmmsg:.*syscalls.packet')" = 1.000 ]; then
+    pass ${p}_udp-batch1
+  else
+    fail ${p}_udp-batch1
+  fi
+  run ${p}_udp 200 0 0 20 -x 32 -t 40 -F 3 > $out.udp
+  if [ "$(field $out.udp 'delivered to application:')" = 200 ]; then
+    pass ${p}_udp-wide
+  else
+    fail ${p}_udp-wide
+  fi
+done
+
+[ $failures -eq 0 ]
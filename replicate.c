@@ -0,0 +1,163 @@
+/* ******************************************************************
+   ADAPTIVE REPLICATION
+
+   Puts error bars on the figures a run reports, with no more replicas
+   than the precision asked for needs.
+   - REPL_MIN replicas (or one per job, if more) are run first; after
+   each batch a Student t interval is worked out for every metric
+   - the replicas still needed are estimated from the widest interval
+   relative to its mean (the width shrinks with the square root of the
+   number of replicas), but a batch at most doubles what has been run,
+   so one noisy estimate cannot waste much
+   - the first replica uses the usual seed, so it is the plain run
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "runner.h"
+#include "replicate.h"
+
+#define REPL_MIN   5                /* replicas before the first interval */
+#define REPL_MAX   1000             /* give up on the precision after this many */
+#define REPL_SEED  9999             /* seed of the first replica */
+
+#define NMETRICS   8
+
+static const char *names[NMETRICS] = {
+  "messages delivered to application",
+  "bytes delivered per time unit",
+  "packet resends by A",
+  "messages dropped due to full window",
+  "new ACKs received at A",
+  "mean delivery latency",
+  "p99 delivery latency",
+  "simulated time"
+};
+
+static double value(const struct runresult *r, int m)
+{
+  switch (m) {
+  case 0: return r->delivered;
+  case 1: return r->goodput;
+  case 2: return r->resent;
+  case 3: return r->refused;
+  case 4: return r->acks;
+  case 5: return r->mean;
+  case 6: return r->p99;
+  default: return r->simtime;
+  }
+}
+
+/* two sided 95% quantile of Student's t with df degrees of freedom */
+static double t95(int df)
+{
+  static const double table[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+
+  if (df < 1)
+    df = 1;
+  if (df <= 30)
+    return table[df - 1];
+  return 1.960 + 2.37 / df;         /* first term of the expansion in 1/df */
+}
+
+/* mean and interval half width of metric m over the replicas that ran */
+static void interval(const struct runresult *res, int n, int m, double *mean, double *half)
+{
+  double sum = 0.0, sq = 0.0, x;
+  int i, k = 0;
+
+  for (i=0; i<n; i++)
+    if (res[i].ok) {
+      sum += value(&res[i], m);
+      k++;
+    }
+  *mean = k ? sum / k : 0.0;
+  *half = 0.0;
+  if (k < 2)
+    return;
+  for (i=0; i<n; i++)
+    if (res[i].ok) {
+      x = value(&res[i], m) - *mean;
+      sq += x * x;
+    }
+  *half = t95(k - 1) * sqrt(sq / (k - 1) / k);
+}
+
+/* half width relative to the mean; a metric that is always 0 is exact */
+static double relative(double mean, double half)
+{
+  if (half == 0.0)
+    return 0.0;
+  return mean != 0.0 ? half / fabs(mean) : HUGE_VAL;
+}
+
+void replicate(double precision, int nsim, int jobs)
+{
+  struct runcfg *cfg;
+  struct runresult *res;
+  double mean, half, worst, need;
+  int n, ok, batch, i, m, widest;
+
+  cfg = malloc(REPL_MAX * sizeof(struct runcfg));
+  res = malloc(REPL_MAX * sizeof(struct runresult));
+  if (cfg == NULL || res == NULL) {
+    printf("memory allocation for replication failed.");
+    exit(EXIT_FAILURE);
+  }
+  printf("\nreplicating runs of %d messages until every 95%% confidence interval is within %g%% of its mean, %d jobs\n",
+         nsim, 100.0 * precision, jobs);
+
+  n = 0;
+  batch = (jobs > REPL_MIN) ? jobs : REPL_MIN;
+  while (1) {
+    if (batch > REPL_MAX - n)
+      batch = REPL_MAX - n;
+    for (i=n; i<n + batch; i++) {
+      cfg[i].window = 0;
+      cfg[i].timeout = 0.0;
+      cfg[i].nsim = nsim;
+      cfg[i].seed = REPL_SEED + i;
+    }
+    run_replicas(cfg + n, res + n, batch, jobs);
+    n += batch;
+
+    for (i=ok=0; i<n; i++)
+      ok += res[i].ok;
+    worst = 0.0;
+    widest = 0;
+    for (m=0; m<NMETRICS; m++) {
+      interval(res, n, m, &mean, &half);
+      if (relative(mean, half) > worst) {
+        worst = relative(mean, half);
+        widest = m;
+      }
+    }
+    if (ok < 2)
+      worst = HUGE_VAL;
+    printf("after %d replicas:  widest interval +-%.2f%% (%s)\n", n, 100.0 * worst, names[widest]);
+    if (worst <= precision || n >= REPL_MAX)
+      break;
+
+    /* the width goes with 1/sqrt(replicas) */
+    need = (ok < 2 || worst == HUGE_VAL) ? n : ok * (worst / precision) * (worst / precision) - ok;
+    batch = (need > n) ? n : (int)ceil(need);
+    if (batch < jobs)
+      batch = jobs;
+    if (batch < 1)
+      batch = 1;
+  }
+
+  printf("\nreplication:  %d replicas (%d failed), 95%% confidence intervals\n", n, n - ok);
+  for (m=0; m<NMETRICS; m++) {
+    interval(res, n, m, &mean, &half);
+    printf("  %-40s %14f +- %f (%.2f%%)\n", names[m], mean, half, 100.0 * relative(mean, half));
+  }
+  if (worst > precision)
+    printf("precision of %g%% not reached after %d replicas \n", 100.0 * precision, n);
+  free(cfg);
+  free(res);
+}
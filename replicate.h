@@ -0,0 +1,8 @@
+/* replication (-P precision): instead of one run with the usual seed,  */
+/* independent replicas with seeds 9999, 10000, ... are run in parallel */
+/* (runner.c) until the 95% confidence interval of every reported       */
+/* metric is within the given fraction of its mean, e.g. 0.02 for 2%.   */
+
+/* replicate runs of nsim messages, at most jobs at a time, and print  */
+/* the mean and confidence interval of each metric                     */
+extern void replicate(double, int, int);
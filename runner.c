@@ -0,0 +1,91 @@
+/* ******************************************************************
+   PARALLEL REPLICAS
+
+   Runs simulations side by side for the tuner (tune.c) and for
+   replication (replicate.c).
+   - every replica is a fork() of the emulator taken before it has
+   simulated anything, so replicas share no state and need no reset
+   - results are written straight into an anonymous shared mapping,
+   one slot per replica, so no pipes or parsing are needed
+   - a replica that exits early (a protocol or FEC error, a crash) keeps
+   ok == 0 and is left out by the caller
+   - with a result cache (cache.c) the replicas found in it are not run,
+   and the ones that ran to the end are added to it
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "runner.h"
+#include "cache.h"
+
+int run_jobs(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (int)n : 1;
+}
+
+void run_replicas(const struct runcfg *cfg, struct runresult *res, int n, int jobs)
+{
+  struct runresult *shared;
+  int *todo;
+  int next, running, nrun, i;
+  pid_t pid;
+
+  if (n <= 0)
+    return;
+  if (jobs < 1)
+    jobs = 1;
+  shared = mmap(NULL, n * sizeof(struct runresult), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  todo = malloc(n * sizeof(int));
+  if (shared == MAP_FAILED || todo == NULL) {
+    perror("runner: mmap");
+    exit(EXIT_FAILURE);
+  }
+  memset(shared, 0, n * sizeof(struct runresult));
+
+  /* the replicas that have to be simulated */
+  for (i=nrun=0; i<n; i++)
+    if (!cache_active() || !cache_get(&cfg[i], &shared[i]))
+      todo[nrun++] = i;
+
+  /* anything still buffered would be printed again by every child */
+  fflush(stdout);
+  fflush(stderr);
+  for (next = running = 0; next < nrun || running > 0; ) {
+    while (running < jobs && next < nrun) {
+      pid = fork();
+      if (pid < 0) {
+        perror("runner: fork");
+        exit(EXIT_FAILURE);
+      }
+      if (pid == 0) {
+        /* the replica's own report and warnings are of no interest */
+        if (freopen("/dev/null", "w", stdout) == NULL)
+          _exit(EXIT_FAILURE);
+        run_replica(&cfg[todo[next]], &shared[todo[next]]);
+        shared[todo[next]].ok = 1;
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+      }
+      next++;
+      running++;
+    }
+    if (wait(NULL) > 0)
+      running--;
+    else
+      running = 0;
+  }
+
+  if (cache_active())
+    for (i=0; i<nrun; i++)
+      if (shared[todo[i]].ok)
+        cache_put(&cfg[todo[i]], &shared[todo[i]]);
+  memcpy(res, shared, n * sizeof(struct runresult));
+  munmap(shared, n * sizeof(struct runresult));
+  free(todo);
+}
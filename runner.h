@@ -0,0 +1,39 @@
+/* replicas: simulations of the channel given at start up, each with    */
+/* its own window, timeout, length and seed, run side by side in child  */
+/* processes for the tuner (tune.c) and for replication (replicate.c).  */
+/* The emulator forks before simulating anything, so every child starts */
+/* from the same clean state.                                           */
+
+struct runcfg {
+  int window;                /* window, 0 to keep -x or the protocol's own */
+  float timeout;             /* timeout, 0 to keep -t or the protocol's own */
+  int nsim;                  /* number of messages to simulate */
+  unsigned int seed;         /* for rand() and the traffic generator */
+};
+
+struct runresult {
+  int ok;                    /* non zero if the replica ran to the end */
+  double simtime;            /* time at which the simulation ended */
+  long bytes;                /* bytes delivered to layer 5 at B */
+  double goodput;            /* bytes delivered per time unit */
+  double mean, p99;          /* delivery latency */
+  int delivered;             /* messages delivered to layer 5 */
+  int resent;                /* packets resent by A */
+  int refused;               /* messages dropped due to full window */
+  int acks;                  /* new ACKs received at A */
+};
+
+/* run one replica in this process and fill in the result; provided by */
+/* the emulator                                                          */
+extern void run_replica(const struct runcfg *, struct runresult *);
+
+/* one line describing everything that decides the result of a replica, */
+/* for the result cache (cache.h); provided by the emulator               */
+extern void run_describe(const struct runcfg *, char *, size_t);
+
+/* run n replicas with at most jobs of them at the same time; with a */
+/* result cache, only the ones not in it are simulated               */
+extern void run_replicas(const struct runcfg *, struct runresult *, int, int);
+
+/* default number of jobs: one per online processor */
+extern int run_jobs(void);
@@ -3,6 +3,10 @@
 #include <stdbool.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "checksum.h"
+#include "checkpoint.h"
+#include "fec.h"
+#include "cwnd.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,35 +24,71 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - optional NAKs (-N): B NAKs each gap in what it has received and A
+   resends just that packet, without waiting for the timeout
+   - optional XOR parity FEC (-F k, see fec.c)
+   - optional congestion window (-W, see cwnd.c).  ACKs that leave a
+   gap at the front of the window count as duplicates; on the third A
+   cuts the window and resends the first packet at once
+   - the window (-x, with a sequence space of twice the window) and the
+   timeout (-t) can be chosen at run time, e.g. by the tuner (-T)
+   - A_idle(), A_fastforward() and B_fastforward() let the emulator's
+   hybrid mode (-H) skip packets sent and ACKed while nothing else is
+   in flight; A_state() and B_state() let it (-H -H) find a stretch of
+   a full window that repeats itself
+   - the per slot flags of both windows are bit masks, and A finds the
+   slot of an ACK or NAK from its sequence number instead of searching
+   the window, so the packets are only touched to resend or release them
+   - there is no per slot send time or resend count: the one timer has a
+   fixed timeout (-t) and nothing estimates the RTT, and layer 3 already
+   counts how often each packet was sent (pktsends() in pktbuf.c)
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 12      /* the min sequence space for GBN must be at least windowsize + 1 */
+#ifndef SEQSPACE
+#define SEQSPACE 12      /* at least 2 * windowsize; regress.sh builds a larger one */
+#endif
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define NAK (-2)        /* seqnum of a NAK from B; acknum is the missing packet */
+#define MAXWINDOW 32    /* largest window that can be chosen at run time (-x),
+                           at most the bits in an unsigned int */
+#define SLOT(i) (1u << (i))  /* the bit of window slot i */
+
+/* the window, sequence space and timeout actually used: the values above
+   unless -x or -t choose others (window_size, rtt_timeout) */
+static int windowsize, seqspace;
+static double rtt;
+
+/* the protocol, for the result cache key (cache.h) */
+const char protocol_name[] = "sr";
+
+static void setsizes(void)
+{
+  if (window_size > MAXWINDOW) {
+    fprintf(stderr, "the window can be at most %d packets\n", MAXWINDOW);
+    exit(EXIT_FAILURE);
+  }
+  windowsize = (window_size > 0) ? window_size : WINDOWSIZE;
+  seqspace = (window_size > 0) ? 2 * windowsize : SEQSPACE;
+  rtt = (rtt_timeout > 0.0) ? rtt_timeout : RTT;
+}
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
+   the packet is corrupted.  The algorithm is the one selected with -k (CRC-32C by
+   default), see checksum.c.
 */
-int ComputeChecksum(struct pkt packet)
+int ComputeChecksum(struct pkt *packet)
 {
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  return cksum_packet(packet);
 }
 
-bool IsCorrupted(struct pkt packet)
+bool IsCorrupted(struct pkt *packet)
 {
-  if (packet.checksum == ComputeChecksum(packet))
+  if (packet->checksum == ComputeChecksum(packet))
     return (false);
   else
     return (true);
@@ -56,48 +96,52 @@ bool IsCorrupted(struct pkt packet)
 
 
 /********* Sender (A) variables and functions ************/
-static bool acked[WINDOWSIZE]; 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+static unsigned int acked;            /* SLOT(i): the packet in slot i has been ACKed */
+static struct pkt *buffer[MAXWINDOW]; /* array for storing packets waiting for ACK */
 static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
 static int windowcount;                /* the number of packets currently awaiting an ACK */
 static int A_nextseqnum;               /* the next sequence number to be used by the sender */
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+void A_output(struct msg *message)
 {
-  struct pkt sendpkt;
+  struct pkt *sendpkt;
   int i;
 
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
+  if ( windowcount < cwnd_window()) {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
     /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
+    sendpkt = allocpkt();
+    sendpkt->seqnum = A_nextseqnum;
+    sendpkt->acknum = (fec_block > 0) ? fec_blocknum() : NOTINUSE;
+    sendpkt->length = message->length;
+    for ( i=0; i<message->length ; i++ )
+      sendpkt->payload[i] = message->data[i];
+    sendpkt->checksum = ComputeChecksum(sendpkt);
+
+    /* put packet in window buffer, the window owns this reference */
     /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
+    windowlast = (windowlast + 1) % windowsize;
     buffer[windowlast] = sendpkt;
-    acked[windowlast] = false;
+    acked &= ~SLOT(windowlast);
     windowcount++;
 
     /* send out packet */
     if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+      printf("Sending packet %d to layer 3\n", sendpkt->seqnum);
     tolayer3 (A, sendpkt);
+    if (fec_block > 0)
+      fec_sent(sendpkt);
 
     /* start timer if first packet in window */
     if (windowcount == 1)
-      starttimer(A,RTT);
+      starttimer(A,rtt);
 
     /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    A_nextseqnum = (A_nextseqnum + 1) % seqspace;
   }
   /* if blocked,  window is full */
   else {
@@ -107,45 +151,90 @@ void A_output(struct msg message)
   }
 }
 
+/* the window slot of the packet with this seqnum, or -1 if it is not in
+   the window.  The window holds consecutive sequence numbers ending just
+   before A_nextseqnum. */
+static int A_slot(int seqnum)
+{
+    int offset;
+
+    if (seqnum < 0 || seqnum >= seqspace)
+        return -1;
+    offset = (seqnum - A_nextseqnum + windowcount + seqspace) % seqspace;
+    if (offset >= windowcount)
+        return -1;
+    return (windowfirst + offset) % windowsize;
+}
+
+/* NAK for seqnum: resend that packet now if it is still unacknowledged.
+   The timer keeps running for the first packet in the window. */
+static void A_nak(int seqnum)
+{
+    int buffer_idx = A_slot(seqnum);
+
+    if (buffer_idx >= 0 && !(acked & SLOT(buffer_idx))) {
+        if (TRACE > 0)
+            printf ("---A: NAK %d received, resending packet %d\n", seqnum, seqnum);
+        tolayer3(A, buffer[buffer_idx]);
+        packets_resent++;
+        nak_resends++;
+        cwnd_loss();
+        return;
+    }
+    if (TRACE > 0)
+        printf ("----A: NAK %d is not for a packet in the window, do nothing!\n", seqnum);
+}
+
 /* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
+   In this practical this will always be an ACK (or a NAK) as B never sends data.
 */
-void A_input(struct pkt packet)
+void A_input(struct pkt *packet)
 {
-    int i;
+    int buffer_idx, slid = 0;
   /* if received ACK is not corrupted */
     if (!IsCorrupted(packet)) {
+        if (packet->seqnum == NAK) {
+            A_nak(packet->acknum);
+            return;
+        }
         if (TRACE > 0)
-            printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
+            printf("----A: uncorrupted ACK %d is received\n",packet->acknum);
         total_ACKs_received++;
 
     /* check if individual packets has been ACKed */
         if (windowcount != 0) {
-            int seqfirst = buffer[windowfirst].seqnum;
-            int seqlast = buffer[windowlast].seqnum;
-            /* check case when seqnum has and hasn't wrapped */
-            if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-                ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
+            buffer_idx = A_slot(packet->acknum); /* the slot of the ACKed packet, if it is in the window */
+            if (buffer_idx >= 0) {
             /* packet is a new ACK */
                 if (TRACE > 0)
-                    printf("----A: ACK %d is not a duplicate\n",packet.acknum);
+                    printf("----A: ACK %d is not a duplicate\n",packet->acknum);
                 new_ACKs++;
-                for (i = 0; i < windowcount; i++) {
-                    int buffer_idx = (windowfirst + i) % WINDOWSIZE; /*calculate the index of the current packet in the window*/
-                    if (buffer[buffer_idx].seqnum == packet.acknum && !acked[buffer_idx]) {
-                        acked[buffer_idx] = true;
-                        
-                        while (windowcount > 0 && acked[windowfirst]) {
-                            acked[windowfirst] = false; /* mark the first packet in the window as unacknowledged */
-                            windowfirst = (windowfirst + 1) % WINDOWSIZE;
-                            windowcount--;
-                            stoptimer(A);
-
-                            if (windowcount > 0)
-                                starttimer(A, RTT); /*restart the timer for the next packet if the window is not empty*/
-                        }
-                        break;
-                    }                  
+                if (!(acked & SLOT(buffer_idx))) {
+                    acked |= SLOT(buffer_idx);
+
+                    while (windowcount > 0 && (acked & SLOT(windowfirst))) {
+                        acked &= ~SLOT(windowfirst); /* mark the first packet in the window as unacknowledged */
+                        releasepkt(buffer[windowfirst]);
+                        buffer[windowfirst] = NULL;
+                        windowfirst = (windowfirst + 1) % windowsize;
+                        windowcount--;
+                        slid++;
+                        stoptimer(A);
+
+                        if (windowcount > 0)
+                            starttimer(A, rtt); /*restart the timer for the next packet if the window is not empty*/
+                    }
+                }
+                /* an ACK behind a gap: the first packet may be lost */
+                if (slid > 0)
+                    cwnd_acked(slid);
+                else if (cwnd_dupack()) {
+                    if (TRACE > 0)
+                        printf ("---A: third ACK behind packet %d, resending it\n", buffer[windowfirst]->seqnum);
+                    tolayer3(A, buffer[windowfirst]);
+                    packets_resent++;
+                    stoptimer(A);
+                    starttimer(A, rtt);
                 }
             }
         }
@@ -166,10 +255,11 @@ void A_timerinterrupt(void)
         printf("----A: time out,resend packets!\n");
 
     if (TRACE > 0)
-        printf ("---A: resending packet %d\n", (buffer[windowfirst]).seqnum);
+        printf ("---A: resending packet %d\n", buffer[windowfirst]->seqnum);
+    cwnd_timeout();
     packets_resent++;
     tolayer3(A, buffer[windowfirst]);
-    starttimer(A, RTT);
+    starttimer(A, rtt);
 }
 
 
@@ -179,6 +269,7 @@ void A_init(void)
 {
   /* initialise A's window, buffer and sequence number */
   int i;
+  setsizes();
   A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
   windowfirst = 0;
   windowlast = -1;   /* windowlast is where the last packet sent is stored.
@@ -186,9 +277,66 @@ void A_init(void)
 		     so initially this is set to -1
 		   */
   windowcount = 0;
-  for (i = 0; i < WINDOWSIZE; i++){
-    acked[i] = false;
+  acked = 0;
+  for (i = 0; i < windowsize; i++)
+    buffer[i] = NULL;
+  fec_init(seqspace);
+  cwnd_init(windowsize);
+}
+
+/* -H: nothing is in flight when the window is empty */
+double A_idle(void)
+{
+  return (windowcount == 0) ? rtt : 0.0;
+}
+
+/* -H: a packet was sent from the empty window and ACKed, which slid it out */
+void A_fastforward(void)
+{
+  windowlast = (windowlast + 1) % windowsize;
+  windowfirst = (windowfirst + 1) % windowsize;
+  A_nextseqnum = (A_nextseqnum + 1) % seqspace;
+  total_ACKs_received++;
+  new_ACKs++;
+}
+
+/* the slot flags in mask turned so that slot first is in bit 0 */
+static unsigned int fromslot(unsigned int mask, int first)
+{
+    if (first == 0)
+        return mask;
+    return ((mask >> first) | (mask << (windowsize - first))) & (~0u >> (MAXWINDOW - windowsize));
+}
+
+/* -H -H: where the window is and which of its packets are ACKed, counted
+   from its front rather than by slot */
+unsigned long A_state(void)
+{
+    unsigned long front = fromslot(acked, windowfirst);
+
+    return (front * (MAXWINDOW + 1) + windowcount) * seqspace + A_nextseqnum;
+}
+
+/* save or restore A's state; the window holds one reference to each packet */
+void A_checkpoint(void)
+{
+  int i;
+
+  ckpt_tag("sr A");
+  CKPT(windowsize);
+  CKPT(seqspace);
+  CKPT(rtt);
+  if (windowsize < 1 || windowsize > MAXWINDOW || seqspace <= windowsize) {
+    fprintf(stderr, "checkpoint: bad window size %d\n", windowsize);
+    exit(EXIT_FAILURE);
   }
+  CKPT(windowfirst);
+  CKPT(windowlast);
+  CKPT(windowcount);
+  CKPT(A_nextseqnum);
+  CKPT(acked);
+  for (i = 0; i < windowsize; i++)
+    ckpt_pkt(&buffer[i]);
 }
 
 
@@ -197,57 +345,109 @@ void A_init(void)
 
 static int expectedseqnum; /* the sequence number expected next by the receiver */
 static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
-static struct pkt recvbuf[WINDOWSIZE];
-static bool  recvd[WINDOWSIZE];
+static struct pkt *recvbuf[MAXWINDOW]; /* held references to buffered packets */
+static unsigned int recvd;        /* SLOT(i): recvbuf[i] holds a packet */
+static unsigned int naked;        /* SLOT(i): a NAK has been sent for this missing packet */
+
+/* with -N: the packet seqnum arrived ahead of expectedseqnum, so every
+   packet in between that is still missing is a gap.  Each one is NAKed
+   once; should the resent packet be lost too, A's timer recovers it. */
+static void B_naks(int seqnum)
+{
+    struct pkt *nakpkt;
+    int s, buffer_idx;
+
+    for (s = expectedseqnum; s != seqnum; s = (s + 1) % seqspace) {
+        buffer_idx = s % windowsize;
+        if ((recvd | naked) & SLOT(buffer_idx))
+            continue;
+        if (TRACE > 0)
+            printf("----B: packet %d is missing, send NAK!\n", s);
+        nakpkt = allocpkt();
+        nakpkt->seqnum = NAK;
+        nakpkt->acknum = s;
+        nakpkt->length = 0;
+        nakpkt->checksum = ComputeChecksum(nakpkt);
+        tolayer3(B, nakpkt);
+        releasepkt(nakpkt);
+        naked |= SLOT(buffer_idx);
+        naks_sent++;
+    }
+}
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+void B_input(struct pkt *packet)
 {
-    struct pkt sendpkt;
-    int i;
+    struct pkt *sendpkt, *fixed;
     int buffer_idx;
 
+    /* FEC: keep the packet for its block, or repair the block with a parity packet */
+    if (fec_block > 0 && !IsCorrupted(packet)) {
+        if (fec_isparity(packet)) {
+            fixed = fec_recover(packet);
+            if (fixed != NULL) {
+                B_input(fixed);     /* the rest of the block is buffered already */
+                releasepkt(fixed);
+            }
+            return;
+        }
+        fec_received(packet);
+    }
+
+    sendpkt = allocpkt();
+
     if (!IsCorrupted(packet)) {
         /* new delivery window, accounting for wrap‑around */
-        int diff = (packet.seqnum - expectedseqnum + SEQSPACE) % SEQSPACE;
-        if (diff < WINDOWSIZE) {
+        int diff = (packet->seqnum - expectedseqnum + seqspace) % seqspace;
+        if (diff < windowsize) {
             if (TRACE > 0)
-                printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+                printf("----B: packet %d is correctly received, send ACK!\n",packet->seqnum);
             packets_received++;
 
             /* buffer out‑of‑order or deliver if exactly expected */
-            buffer_idx = packet.seqnum % WINDOWSIZE; /*get index of received packet in the buffer*/
-            if (!recvd[buffer_idx]) {
-                recvbuf[buffer_idx] = packet; /*store the packet in the buffer*/
-                recvd[buffer_idx]   = true; /*Mark the packet as received*/
+            buffer_idx = packet->seqnum % windowsize; /*get index of received packet in the buffer*/
+            if (!(recvd & SLOT(buffer_idx))) {
+                recvbuf[buffer_idx] = holdpkt(packet); /*store the packet in the buffer*/
+                recvd |= SLOT(buffer_idx); /*Mark the packet as received*/
             }
             /* ACK every valid in‑window packet */
-            sendpkt.acknum = packet.seqnum;
+            sendpkt->acknum = packet->seqnum;
+
+            /* ahead of the expected packet: NAK the gap before it */
+            if (use_naks && packet->seqnum != expectedseqnum)
+                B_naks(packet->seqnum);
 
             /* now deliver any in‑sequence run starting at expectedseqnum */
-            buffer_idx = expectedseqnum % WINDOWSIZE;
-            while (recvd[buffer_idx]) {
-                tolayer5(B, recvbuf[buffer_idx].payload); /*deliver the packet's payload to layer 5*/
-                recvd[buffer_idx] = false;
+            buffer_idx = expectedseqnum % windowsize;
+            while (recvd & SLOT(buffer_idx)) {
+                tolayer5(B, recvbuf[buffer_idx]->payload, recvbuf[buffer_idx]->length); /*deliver the packet's payload to layer 5*/
+                recvd &= ~SLOT(buffer_idx);
+                naked &= ~SLOT(buffer_idx);
+                releasepkt(recvbuf[buffer_idx]);
+                recvbuf[buffer_idx] = NULL;
 
                 /* update state variables */
-                expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+                expectedseqnum = (expectedseqnum + 1) % seqspace;
 
-                buffer_idx = expectedseqnum % WINDOWSIZE;
+                buffer_idx = expectedseqnum % windowsize;
             }
         }
         else {
             /* check already-delivered window → ACK the packet again */
-            int back = (expectedseqnum - packet.seqnum + SEQSPACE) % SEQSPACE;
+            int back = (expectedseqnum - packet->seqnum + seqspace) % seqspace;
 
-            /* packet.seqnum in [rcv_base−WINDOWSIZE … rcv_base−1] */
+            /* packet->seqnum in [rcv_base−windowsize … rcv_base−1] */
             /* i.e. it’s a duplicate of something we already delivered */
-            if (back > 0 && back <= WINDOWSIZE) {
+            if (back > 0 && back <= windowsize) {
                 if (TRACE > 0)
-                    printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+                    printf("----B: packet %d is correctly received, send ACK!\n",packet->seqnum);
                 packets_received++;
-                sendpkt.acknum = packet.seqnum;
+                sendpkt->acknum = packet->seqnum;
             }
+            /* not a sequence number of ours: resend the last in order ACK,
+               the buffer may be a recycled one holding an old acknum */
+            else
+                sendpkt->acknum = (expectedseqnum + seqspace - 1) % seqspace;
         }
     }
     else {
@@ -255,18 +455,18 @@ void B_input(struct pkt packet)
         if (TRACE > 0)
             printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
         if (expectedseqnum == 0)
-            sendpkt.acknum = SEQSPACE - 1;
+            sendpkt->acknum = seqspace - 1;
         else
-            sendpkt.acknum = expectedseqnum - 1;
+            sendpkt->acknum = expectedseqnum - 1;
     }
   /* build and send the ACK (keeping your alternating seqnum) */
-    sendpkt.seqnum   = B_nextseqnum;
+    sendpkt->seqnum   = B_nextseqnum;
     B_nextseqnum     = (B_nextseqnum + 1) % 2;
-    /* we don't have any data to send.  fill payload with 0's */
-    for ( i=0; i<20 ; i++ )
-        sendpkt.payload[i] = '0';
-    sendpkt.checksum = ComputeChecksum(sendpkt);
+    /* we don't have any data to send, the ACK has no payload */
+    sendpkt->length = 0;
+    sendpkt->checksum = ComputeChecksum(sendpkt);
     tolayer3(B, sendpkt);
+    releasepkt(sendpkt);
 }
 
 /* the following routine will be called once (only) before any other */
@@ -274,19 +474,52 @@ void B_input(struct pkt packet)
 void B_init(void)
 {
     int i;
+    setsizes();
     expectedseqnum = 0;
-    for(i = 0; i < WINDOWSIZE; i++){ 
-      recvd[i] = false;
-    }
+    recvd = naked = 0;
+    for(i = 0; i < windowsize; i++)
+      recvbuf[i] = NULL;
     B_nextseqnum = 1;
 }
 
+/* -H: the expected packet arrived, was ACKed and delivered at once */
+void B_fastforward(void)
+{
+    packets_received++;
+    expectedseqnum = (expectedseqnum + 1) % seqspace;
+    B_nextseqnum = (B_nextseqnum + 1) % 2;
+}
+
+/* -H -H: the packet expected, the ACK's alternating seqnum, and which of
+   the packets after it are held or NAKed */
+unsigned long B_state(void)
+{
+    unsigned long held = fromslot(recvd, expectedseqnum % windowsize);
+    unsigned long nakedfront = fromslot(naked, expectedseqnum % windowsize);
+
+    return ((held * 31 + nakedfront) * seqspace + expectedseqnum) * 2 + B_nextseqnum;
+}
+
+/* save or restore B's state, including the packets held out of order */
+void B_checkpoint(void)
+{
+    int i;
+
+    ckpt_tag("sr B");
+    CKPT(expectedseqnum);
+    CKPT(B_nextseqnum);
+    CKPT(recvd);
+    CKPT(naked);
+    for (i = 0; i < windowsize; i++)
+      ckpt_pkt(&recvbuf[i]);
+}
+
 /******************************************************************************
  * The following functions need be completed only for bi-directional messages *
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+void B_output(struct msg *message)
 {
 }
 
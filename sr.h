@@ -1,11 +1,35 @@
 extern void A_init(void);
 extern void B_init(void);
-extern void A_input(struct pkt);
-extern void B_input(struct pkt);
-extern void A_output(struct msg);
+extern void A_input(struct pkt *);
+extern void B_input(struct pkt *);
+extern void A_output(struct msg *);
 extern void A_timerinterrupt(void);
 
 /* included for extension to bidirectional communication */
 #define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
-extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+extern void B_output(struct msg *);
+extern void B_timerinterrupt(void);
+
+/* protocol name, part of the result cache key */
+extern const char protocol_name[];
+
+/* hybrid mode (-H): A_idle() returns the timeout A starts for its next
+   packet if nothing is waiting for an ACK, and 0 otherwise.  The emulator
+   then skips the events of a packet that goes through without loss or
+   corruption and is ACKed before anything else happens, and calls
+   A_fastforward() and B_fastforward() to leave the state it would have */
+extern double A_idle(void);
+extern void A_fastforward(void);
+extern void B_fastforward(void);
+
+/* with -H given twice: A_state() and B_state() return a number that
+   changes with everything in A's and B's state that decides what they
+   do next, but not with counters or with which buffer slot holds which
+   packet.  When both come back to earlier values with nothing lost,
+   resent or timed out since, the emulator repeats that stretch in bulk */
+extern unsigned long A_state(void);
+extern unsigned long B_state(void);
+
+/* save or restore the protocol state in a checkpoint (checkpoint.h) */
+extern void A_checkpoint(void);
+extern void B_checkpoint(void);
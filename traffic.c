@@ -0,0 +1,261 @@
+/* ******************************************************************
+   TRAFFIC GENERATORS
+
+   Inter-arrival times for layer 5 messages.  Apart from the original
+   uniform generator (still drawn in the emulator from jimsrand(), so
+   existing runs are unchanged) every generator:
+   - has its own random number stream (erand48), so choosing a different
+   arrival process does not shift the loss and corruption draws
+   - is precomputed TRAFFIC_BATCH gaps at a time, so the event loop only
+   reads the next value out of an array
+   ********************************************************************* */
+#define _XOPEN_SOURCE 600
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "emulator.h"
+#include "checkpoint.h"
+#include "traffic.h"
+
+#define TRAFFIC_BATCH 4096
+
+#define UNIFORM  0
+#define POISSON  1
+#define ONOFF    2
+#define TRACEFILE 3
+
+static int kind = UNIFORM;
+static double mean;                   /* lambda: mean gap between messages */
+static unsigned short xsubi[3];       /* erand48() state */
+static char name[128] = "uniform";
+
+static double batch[TRAFFIC_BATCH];   /* precomputed gaps */
+static int nbatch, nextgap;
+
+/* on/off state */
+static double alpha, meanon, meanoff; /* Pareto shape and mean durations */
+static double onleft;                 /* time left in the current ON period */
+static double ongap;                  /* mean gap between arrivals while ON */
+
+/* trace state */
+static FILE *tracefp;
+static char tracepath[4096];
+static double lastarrival;
+static int traceended;
+static unsigned long long tracehash;  /* FNV-1a of the file's contents */
+
+static double uniform01(void)
+{
+  double u;
+
+  do
+    u = erand48(xsubi);
+  while (u == 0.0);                   /* callers take logs and powers */
+  return u;
+}
+
+static double exponential(double m)
+{
+  return -m * log(uniform01());
+}
+
+/* Pareto with shape alpha (> 1) and the given mean */
+static double pareto(double m)
+{
+  return m * (alpha - 1.0) / alpha / pow(uniform01(), 1.0 / alpha);
+}
+
+/* next gap of the on/off process: Poisson arrivals inside ON periods,
+   silence during OFF periods */
+static double onoffgap(void)
+{
+  double gap = 0.0, g;
+
+  for (;;) {
+    g = exponential(ongap);
+    if (g <= onleft) {
+      onleft -= g;
+      return gap + g;
+    }
+    gap += onleft + pareto(meanoff);  /* rest of this ON, then an OFF */
+    onleft = pareto(meanon);
+  }
+}
+
+static void refill(void)
+{
+  double t;
+  int i;
+
+  nextgap = 0;
+  nbatch = 0;
+  switch (kind) {
+  case POISSON:
+    for (i=0; i<TRAFFIC_BATCH; i++)
+      batch[i] = exponential(mean);
+    nbatch = TRAFFIC_BATCH;
+    break;
+  case ONOFF:
+    for (i=0; i<TRAFFIC_BATCH; i++)
+      batch[i] = onoffgap();
+    nbatch = TRAFFIC_BATCH;
+    break;
+  case TRACEFILE:
+    while (nbatch < TRAFFIC_BATCH && !traceended) {
+      if (fscanf(tracefp, "%lf", &t) != 1) {
+        traceended = 1;
+        break;
+      }
+      batch[nbatch++] = (t > lastarrival) ? t - lastarrival : 0.0;
+      lastarrival = t;
+    }
+    break;
+  }
+}
+
+int traffic_init(const char *spec, double lambda, unsigned int seed)
+{
+  char *end;
+  int c;
+
+  mean = lambda;
+  xsubi[0] = 0x330e;
+  xsubi[1] = seed & 0xffff;
+  xsubi[2] = (seed >> 16) & 0xffff;
+  nbatch = nextgap = 0;
+  tracehash = 0;
+  /* every replica of a -T or -P run starts here again */
+  if (tracefp != NULL) {
+    fclose(tracefp);
+    tracefp = NULL;
+  }
+
+  if (strcmp(spec, "uniform") == 0) {
+    kind = UNIFORM;
+    strcpy(name, "uniform");
+    return 0;
+  }
+  if (strcmp(spec, "poisson") == 0) {
+    kind = POISSON;
+    sprintf(name, "poisson (mean gap %g)", mean);
+    return 0;
+  }
+  if (strncmp(spec, "onoff", 5) == 0 && (spec[5] == '\0' || spec[5] == ':')) {
+    kind = ONOFF;
+    alpha = 1.5;
+    meanon = 20.0 * lambda;
+    meanoff = -1.0;
+    spec += 5;
+    if (*spec == ':') {
+      alpha = strtod(spec + 1, &end);
+      spec = end;
+    }
+    if (*spec == ':') {
+      meanon = strtod(spec + 1, &end);
+      spec = end;
+    }
+    if (*spec == ':') {
+      meanoff = strtod(spec + 1, &end);
+      spec = end;
+    }
+    if (meanoff < 0.0)
+      meanoff = meanon;
+    if (*spec != '\0' || alpha <= 1.0 || meanon <= 0.0 || lambda <= 0.0)
+      return -1;
+    /* keep the long run mean gap at lambda: all arrivals happen in the
+       ON fraction of the time */
+    ongap = lambda * meanon / (meanon + meanoff);
+    onleft = pareto(meanon);
+    sprintf(name, "pareto on/off (alpha %g, mean on %g, mean off %g, gap while on %g)",
+            alpha, meanon, meanoff, ongap);
+    return 0;
+  }
+  if (strncmp(spec, "trace:", 6) == 0) {
+    kind = TRACEFILE;
+    tracefp = fopen(spec + 6, "r");
+    if (tracefp == NULL)
+      return -1;
+    snprintf(tracepath, sizeof(tracepath), "%s", spec + 6);
+    tracehash = 0xcbf29ce484222325ULL;
+    while ((c = getc(tracefp)) != EOF) {
+      tracehash ^= (unsigned char)c;
+      tracehash *= 0x100000001b3ULL;
+    }
+    rewind(tracefp);
+    lastarrival = 0.0;
+    traceended = 0;
+    snprintf(name, sizeof(name), "trace %s", spec + 6);
+    return 0;
+  }
+  return -1;
+}
+
+int traffic_uniform(void)
+{
+  return kind == UNIFORM;
+}
+
+int traffic_stationary(void)
+{
+  return kind == UNIFORM || kind == POISSON;
+}
+
+double traffic_next(void)
+{
+  if (nextgap == nbatch) {
+    refill();
+    if (nbatch == 0)
+      return -1.0;                    /* trace has run out */
+  }
+  return batch[nextgap++];
+}
+
+const char *traffic_name(void)
+{
+  return name;
+}
+
+unsigned long long traffic_hash(void)
+{
+  return tracehash;
+}
+
+void traffic_checkpoint(void)
+{
+  long offset = 0;
+  int i;
+
+  ckpt_tag("traffic");
+  CKPT(kind);
+  CKPT(mean);
+  CKPT(xsubi);
+  ckpt_string(name, sizeof(name));
+  /* only the gaps not handed out yet */
+  CKPT(nbatch);
+  CKPT(nextgap);
+  for (i=nextgap; i<nbatch; i++)
+    CKPT(batch[i]);
+  CKPT(alpha);
+  CKPT(meanon);
+  CKPT(meanoff);
+  CKPT(onleft);
+  CKPT(ongap);
+  if (kind == TRACEFILE) {
+    ckpt_string(tracepath, sizeof(tracepath));
+    CKPT(lastarrival);
+    CKPT(traceended);
+    if (!ckpt_restoring())
+      offset = ftell(tracefp);
+    CKPT(offset);
+    if (ckpt_restoring()) {
+      if (tracefp != NULL)
+        fclose(tracefp);
+      tracefp = fopen(tracepath, "r");
+      if (tracefp == NULL || fseek(tracefp, offset, SEEK_SET) != 0) {
+        fprintf(stderr, "traffic: cannot reopen arrival trace %s\n", tracepath);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+}
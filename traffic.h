@@ -0,0 +1,34 @@
+/* traffic generators: the process that decides when layer 5 at A has   */
+/* the next message.  Selected with -a:                                 */
+/*   uniform                   - uniform on [0, 2*lambda], the original  */
+/*   poisson                   - exponential gaps with mean lambda       */
+/*   onoff[:alpha[:on[:off]]]  - Pareto distributed ON and OFF periods   */
+/*                               (shape alpha, mean durations on/off in  */
+/*                               time units), Poisson arrivals while ON, */
+/*                               long run mean gap still lambda          */
+/*   trace:file                - arrival times (one per line) from file  */
+
+/* select the generator, given the mean time between messages and a seed */
+/* for its random numbers; returns -1 if the spec is not understood      */
+extern int traffic_init(const char *, double, unsigned int);
+
+/* non zero while the original uniform generator is selected; it keeps */
+/* drawing from jimsrand() so runs stay identical to earlier versions  */
+extern int traffic_uniform(void);
+
+/* non zero if the gaps are independent and all drawn from one distribution */
+/* (uniform, poisson), so any stretch of arrivals is like any other (-H -H) */
+extern int traffic_stationary(void);
+
+/* time until the next arrival, or a negative value when a trace has run out */
+extern double traffic_next(void);
+
+/* description of the selected generator for the run report */
+extern const char *traffic_name(void);
+
+/* FNV-1a hash of the arrival trace's contents, 0 for the other */
+/* generators; part of the result cache key (cache.h)           */
+extern unsigned long long traffic_hash(void);
+
+/* save or restore the generator state in a checkpoint (checkpoint.h) */
+extern void traffic_checkpoint(void);
@@ -0,0 +1,169 @@
+/* ******************************************************************
+   WINDOW AND TIMEOUT TUNER
+
+   Finds the window size and retransmission timeout that do best on one
+   metric for the channel given at start up, without recompiling.
+   - every pair from a fixed grid starts out; each round runs all that
+   are left on the same TUNE_REPLICAS seeds (common random numbers, so
+   the configurations are compared on the same losses and arrivals) and
+   keeps the best 1/TUNE_ETA for the next round, which runs TUNE_ETA
+   times as many messages
+   - the last round runs the full number of messages asked for at start
+   up, so the winner is judged on runs as long as the real one
+   - a configuration with a failed replica (or nothing delivered) drops
+   to the bottom
+   - messages refused by a full window never reach the latency figures,
+   so for p99 only configurations within TUNE_SHARE of the round's best
+   goodput compete; otherwise a window of one would always win
+   - the SEQSPACE suggested for GBN is the one setsizes() in gbn.c picks:
+   twice the window when -M lets packets overtake each other
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "runner.h"
+#include "tune.h"
+
+#define TUNE_REPLICAS 3             /* seeds per configuration and round */
+#define TUNE_ETA      3             /* one in TUNE_ETA goes on to the next round */
+#define TUNE_MINMSGS  50            /* shortest replica */
+#define TUNE_SEED     9999          /* seed of the first replica */
+#define TUNE_SHARE    0.95          /* p99: goodput needed, relative to the best */
+
+/* the grid; windows go up to MAXWINDOW in gbn.c and sr.c */
+static const int windows[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+static const float timeouts[] = { 8.0, 12.0, 16.0, 24.0, 32.0, 48.0, 64.0 };
+#define NWINDOWS  ((int)(sizeof(windows) / sizeof(windows[0])))
+#define NTIMEOUTS ((int)(sizeof(timeouts) / sizeof(timeouts[0])))
+
+struct candidate {
+  int window;
+  float timeout;
+  int ok;                           /* every replica ran and delivered data */
+  int slow;                         /* p99: goodput too far below the best */
+  double goodput, p99;              /* means over the replicas */
+};
+
+static int lowerbetter;             /* p99: smaller is better */
+
+static double score(const struct candidate *c)
+{
+  return lowerbetter ? c->p99 : c->goodput;
+}
+
+/* qsort(): best first, failed ones last */
+static int bestfirst(const void *x, const void *y)
+{
+  const struct candidate *a = x, *b = y;
+
+  if (a->ok != b->ok)
+    return b->ok - a->ok;
+  if (a->slow != b->slow)
+    return a->slow - b->slow;
+  if (score(a) == score(b))
+    return 0;
+  if (lowerbetter)
+    return score(a) < score(b) ? -1 : 1;
+  return score(a) > score(b) ? -1 : 1;
+}
+
+/* run TUNE_REPLICAS replicas of nsim messages for each of the n candidates */
+static void evaluate(struct candidate *cand, int n, int nsim, int round, int jobs)
+{
+  struct runcfg *cfg;
+  struct runresult *res, *r;
+  double best = 0.0;
+  int i, k;
+
+  cfg = malloc(n * TUNE_REPLICAS * sizeof(struct runcfg));
+  res = malloc(n * TUNE_REPLICAS * sizeof(struct runresult));
+  if (cfg == NULL || res == NULL) {
+    printf("memory allocation for the tuner failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<n; i++)
+    for (k=0; k<TUNE_REPLICAS; k++) {
+      cfg[i * TUNE_REPLICAS + k].window = cand[i].window;
+      cfg[i * TUNE_REPLICAS + k].timeout = cand[i].timeout;
+      cfg[i * TUNE_REPLICAS + k].nsim = nsim;
+      cfg[i * TUNE_REPLICAS + k].seed = TUNE_SEED + round * TUNE_REPLICAS + k;
+    }
+  run_replicas(cfg, res, n * TUNE_REPLICAS, jobs);
+
+  for (i=0; i<n; i++) {
+    cand[i].ok = 1;
+    cand[i].goodput = cand[i].p99 = 0.0;
+    for (k=0; k<TUNE_REPLICAS; k++) {
+      r = &res[i * TUNE_REPLICAS + k];
+      if (!r->ok || r->bytes == 0)
+        cand[i].ok = 0;
+      cand[i].goodput += r->goodput / TUNE_REPLICAS;
+      cand[i].p99 += r->p99 / TUNE_REPLICAS;
+    }
+    if (cand[i].ok && cand[i].goodput > best)
+      best = cand[i].goodput;
+  }
+  for (i=0; i<n; i++)
+    cand[i].slow = lowerbetter && cand[i].goodput < TUNE_SHARE * best;
+  free(cfg);
+  free(res);
+}
+
+int tune(const char *metric, int nsim, int jobs)
+{
+  struct candidate *cand;
+  int sizes[16], nrounds, round, budget, i, j, n;
+
+  if (strcmp(metric, "goodput") == 0)
+    lowerbetter = 0;
+  else if (strcmp(metric, "p99") == 0)
+    lowerbetter = 1;
+  else
+    return -1;
+
+  n = NWINDOWS * NTIMEOUTS;
+  cand = malloc(n * sizeof(struct candidate));
+  if (cand == NULL) {
+    printf("memory allocation for the tuner failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<NWINDOWS; i++)
+    for (j=0; j<NTIMEOUTS; j++) {
+      cand[i * NTIMEOUTS + j].window = windows[i];
+      cand[i * NTIMEOUTS + j].timeout = timeouts[j];
+    }
+
+  /* number of candidates in each round, down to TUNE_ETA or fewer */
+  sizes[0] = n;
+  for (nrounds=1; sizes[nrounds - 1] > TUNE_ETA; nrounds++)
+    sizes[nrounds] = (sizes[nrounds - 1] + TUNE_ETA - 1) / TUNE_ETA;
+
+  printf("\ntuning window and timeout for %s, %d configurations, %d rounds, %d jobs\n",
+         metric, n, nrounds, jobs);
+  for (round=0; round<nrounds; round++) {
+    budget = nsim;
+    for (i=round; i<nrounds - 1; i++)
+      budget /= TUNE_ETA;
+    if (budget < TUNE_MINMSGS)
+      budget = (nsim < TUNE_MINMSGS) ? nsim : TUNE_MINMSGS;
+    evaluate(cand, sizes[round], budget, round, jobs);
+    qsort(cand, sizes[round], sizeof(struct candidate), bestfirst);
+    printf("round %d:  %d configurations x %d replicas of %d messages, best window %d timeout %.1f (goodput %f, p99 %.3f)%s\n",
+           round + 1, sizes[round], TUNE_REPLICAS, budget, cand[0].window, cand[0].timeout,
+           cand[0].goodput, cand[0].p99, cand[0].ok ? "" : " - every configuration failed");
+  }
+
+  n = sizes[nrounds - 1];
+  printf("\nfinal round, best first:\n");
+  for (i=0; i<n; i++)
+    printf("  window %2d  timeout %5.1f  goodput %f  p99 %.3f%s\n", cand[i].window, cand[i].timeout,
+           cand[i].goodput, cand[i].p99, !cand[i].ok ? "  (failed)" : cand[i].slow ? "  (low goodput)" : "");
+  printf("best for %s:  window %d, timeout %.1f.  Run with -x %d -t %g, or build with WINDOWSIZE %d,\n"
+         "RTT %.1f and SEQSPACE %d for GBN or %d for SR \n",
+         metric, cand[0].window, cand[0].timeout, cand[0].window, cand[0].timeout,
+         cand[0].window, cand[0].timeout,
+         reordering ? 2 * cand[0].window : cand[0].window + 1, 2 * cand[0].window);
+  free(cand);
+  return 0;
+}
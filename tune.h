@@ -0,0 +1,11 @@
+/* tuner (-T metric): searches the window size and the retransmission   */
+/* timeout for the loss, corruption and load given at start up, with    */
+/* successive halving over seeded replicas run in parallel (runner.c).  */
+/* The metric is "goodput" (bytes per time unit, higher is better) or   */
+/* "p99" (99th percentile delivery latency, lower is better, among the  */
+/* configurations that come close to the best goodput).                */
+
+/* run the search with replicas of up to nsim messages and at most jobs */
+/* at a time, and print the best configuration; returns -1 if the      */
+/* metric is not known                                                  */
+extern int tune(const char *, int, int);
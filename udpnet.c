@@ -0,0 +1,763 @@
+/* ******************************************************************
+   UDP LOOPBACK BACKEND
+
+   This file is a drop-in replacement for emulator.c.  It implements the
+   same four routines the protocol code uses (tolayer3, tolayer5,
+   starttimer and stoptimer) but carries the packets over real UDP
+   sockets on 127.0.0.1 instead of through the simulated event list:
+   - A and B each own a connected, non-blocking UDP socket
+   - each entity's timer is a timerfd, and so is the layer 5 message
+   generator, so every event source is a file descriptor in one epoll set
+   - loss and corruption are injected in userspace, before the packet is
+   handed to the kernel, using the same probabilities and the same
+   corruption patterns as the emulator
+   - every datagram carries its send timestamp so the receiver can
+   measure the real one way latency, then the packed 10 byte header
+   (PKTHEADERBYTES) and only the used part of the payload
+   - packets are gathered from and scattered into the reference counted
+   packet buffers (pktbuf.c) directly, so the only copies are the ones
+   the kernel makes
+   - the MTU (-m), application message size (-s), checksum (-k),
+   arrival process (-a), NAK (-N), FEC (-F), congestion window (-W,
+   -w), window size (-x) and timeout (-t) options work as in the emulator
+   - tolayer3() does not make a system call.  Packets are queued per
+   socket and the whole queue is flushed with one sendmmsg() at the end
+   of each event loop tick (or when it reaches the batch size, -b), and
+   arrivals are drained with recvmmsg().  Batch sizes and system calls
+   per packet are reported; -b 1 gives one system call per packet
+
+   One simulator time unit is mapped onto a configurable number of
+   microseconds of wall clock time (-u, default 100), so RTT and the
+   average time between messages keep their meaning.  The answers asked
+   for at start up are the same as for the emulator, so the same input
+   files can be piped into both.
+
+   Build:  cc -O2 -o gbn_udp udpnet.c pktbuf.c checksum.c traffic.c checkpoint.c fec.c cwnd.c gbn.c -lm
+           cc -O2 -o sr_udp  udpnet.c pktbuf.c checksum.c traffic.c checkpoint.c fec.c cwnd.c sr.c -lm
+   ********************************************************************* */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "checksum.h"
+#include "traffic.h"
+#include "fec.h"
+#include "cwnd.h"
+
+/* epoll tags for the event sources */
+#define  SOCKET_A        0
+#define  SOCKET_B        1
+#define  TIMER_A         2
+#define  TIMER_B         3
+#define  GENERATOR       4
+
+#define  OFF             0
+#define  ON              1
+
+#define  MAXBATCH       64        /* largest sendmmsg/recvmmsg batch */
+
+/* a datagram on the wire is the send time (CLOCK_MONOTONIC nanoseconds
+   at tolayer3()), the packed packet header (pkt_pack()) and the used
+   part of the payload */
+#define  WIREHEADER      (sizeof(int64_t) + PKTHEADERBYTES)
+
+int TRACE = 3;
+
+/* statistics updated by GBN */
+int window_full;   /* count of the number of messages dropped due to full window */
+int total_ACKs_received;
+int packets_resent;       /* count of the number of packets resent  */
+int new_ACKs;           /* count of the number of acks correctly received */
+int packets_received;  /* count of the packets received by receiver */
+int naks_sent;         /* count of the NAKs sent by the receiver */
+int nak_resends;       /* count of the packets resent because of a NAK */
+
+int use_naks = 0;      /* -N */
+int window_size = 0;   /* -x */
+float rtt_timeout = 0.0; /* -t */
+int reordering = 0;    /* the emulator's multipath channel only */
+
+/* statistics updated by the backend */
+static int messages_delivered;
+static long bytes_delivered;
+static int nsim = 0;              /* number of messages from 5 to 4 so far */
+static int nsimmax = 0;           /* number of msgs to generate, then stop */
+static float lossprob;            /* probability that a packet is dropped  */
+static float corruptprob;   /* probability that one bit is packet is flipped */
+static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
+static float lambda;        /* arrival rate of messages from layer 5 */
+static int   ntolayer3;           /* number sent into layer 3 */
+static int   nlost;               /* number lost in userspace */
+static int   ncorrupt;            /* number corrupted in userspace */
+static int   nkernel;             /* number dropped because the kernel refused them (EAGAIN) */
+static int   nfromlayer3;         /* number received from layer 3 */
+static int   mtu = 20;            /* largest payload per packet, -m */
+static int   msgsize = 0;         /* application message size, -s (default mtu) */
+
+static double unitns = 100000.0;  /* nanoseconds per simulator time unit */
+static int64_t starttime;         /* CLOCK_MONOTONIC ns when the run started */
+static int64_t latsum, latmin, latmax; /* one way latency of received packets */
+
+static int sock[2];               /* connected UDP socket of A and B */
+static int timerfd[2];            /* timer of A and B */
+static int timeron[2];            /* ON if the timer of A or B is armed */
+static int genfd;                 /* timer for the next layer 5 arrival */
+static int generating;            /* ON while messages remain to be generated */
+static int epfd;
+static int batchsize = MAXBATCH;  /* packets per sendmmsg/recvmmsg, -b */
+
+/* per socket transmit queue, flushed by flushlayer3() */
+static struct pkt *txpkt[2][MAXBATCH];  /* held references */
+static int64_t txtime[2][MAXBATCH];
+static int txcount[2];
+
+/* batching counters: system calls made and packets they carried */
+static long sendcalls, sendpkts, sendmaxbatch;
+static long recvcalls, recvpkts, recvmaxbatch;
+
+/****************************************************************************/
+/* jimsrand(): return a double in range [0,1].  Same generator as the        */
+/* emulator so a run draws the same loss and corruption decisions.          */
+/****************************************************************************/
+double jimsrand(void)
+{
+  double mmm = RAND_MAX;
+  double x;
+  x = rand()/mmm;
+  if (TRACE > 3)
+    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  return(x);
+}
+
+static int64_t now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* current time in simulator time units since the start of the run */
+static double unitsnow(void)
+{
+  return (now() - starttime) / unitns;
+}
+
+static void fatal(const char *what)
+{
+  perror(what);
+  exit(EXIT_FAILURE);
+}
+
+/* arm (or with increment 0, disarm) a timerfd, increment in time units */
+static void armtimer(int fd, double increment, int disarm)
+{
+  struct itimerspec its;
+  int64_t ns;
+
+  memset(&its, 0, sizeof(its));
+  if (!disarm) {
+    ns = (int64_t)(increment * unitns);
+    if (ns < 1)
+      ns = 1;               /* a zero it_value would disarm the timer */
+    its.it_value.tv_sec = ns / 1000000000;
+    its.it_value.tv_nsec = ns % 1000000000;
+  }
+  if (timerfd_settime(fd, 0, &its, NULL) < 0)
+    fatal("timerfd_settime");
+}
+
+static void watch(int fd, uint32_t tag)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    fatal("epoll_ctl");
+}
+
+/* create A's and B's sockets on loopback and connect them to each other */
+static void opensockets(void)
+{
+  struct sockaddr_in addr[2];
+  socklen_t len;
+  int i;
+
+  for (i=0; i<2; i++) {
+    sock[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock[i] < 0)
+      fatal("socket");
+    memset(&addr[i], 0, sizeof(addr[i]));
+    addr[i].sin_family = AF_INET;
+    addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr[i].sin_port = 0;                /* let the kernel pick a port */
+    if (bind(sock[i], (struct sockaddr *)&addr[i], sizeof(addr[i])) < 0)
+      fatal("bind");
+    len = sizeof(addr[i]);
+    if (getsockname(sock[i], (struct sockaddr *)&addr[i], &len) < 0)
+      fatal("getsockname");
+  }
+  if (connect(sock[A], (struct sockaddr *)&addr[B], sizeof(addr[B])) < 0 ||
+      connect(sock[B], (struct sockaddr *)&addr[A], sizeof(addr[A])) < 0)
+    fatal("connect");
+}
+
+void generate_next_arrival(void)
+{
+  double x;
+
+  if (TRACE>2)
+    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
+
+  if (traffic_uniform())
+    x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+  else if ((x = traffic_next()) < 0.0) {
+    generating = OFF;         /* arrival trace has ended */
+    armtimer(genfd, 0.0, ON);
+    return;
+  }
+  armtimer(genfd, x, OFF);
+}
+
+void init(int argc, char **argv)        /* initialize the backend */
+{
+  float sum, avg;
+  int i, c;
+  char *arrivals = "uniform";
+
+  while ((c = getopt(argc, argv, "u:b:m:s:k:a:NF:Ww:x:t:")) != -1) {
+    switch (c) {
+    case 'a':
+      arrivals = optarg;
+      break;
+    case 'N':
+      use_naks = 1;
+      break;
+    case 'F':
+      fec_block = atoi(optarg);
+      break;
+    case 'W':
+      use_cwnd = 1;
+      break;
+    case 'w':
+      cwnd_log(optarg);
+      break;
+    case 'x':
+      window_size = atoi(optarg);
+      break;
+    case 't':
+      rtt_timeout = atof(optarg);
+      break;
+    case 'k':
+      if (cksum_select(optarg) < 0) {
+        fprintf(stderr, "%s: unknown checksum '%s' (sum, inet or crc32c)\n", argv[0], optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'm':
+      mtu = atoi(optarg);
+      break;
+    case 's':
+      msgsize = atoi(optarg);
+      break;
+    case 'u':
+      unitns = atof(optarg) * 1000.0;
+      break;
+    case 'b':
+      batchsize = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-u usec-per-time-unit] [-b batch-size] [-m mtu] [-s message-size] [-k checksum] [-a arrivals] [-N] [-F k] [-W] [-w cwnd-log] [-x window] [-t timeout]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (unitns <= 0.0) {
+    fprintf(stderr, "%s: time unit must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (window_size < 0 || rtt_timeout < 0.0) {
+    fprintf(stderr, "%s: window and timeout must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (mtu < 1 || mtu > MAXPAYLOAD) {
+    fprintf(stderr, "%s: MTU must be between 1 and %d bytes\n", argv[0], MAXPAYLOAD);
+    exit(EXIT_FAILURE);
+  }
+  if (fec_block < 0 || (fec_block > 0 && mtu > MAXPAYLOAD - FEC_HEADER)) {
+    fprintf(stderr, "%s: FEC needs a positive block size and an MTU of at most %d bytes\n",
+            argv[0], MAXPAYLOAD - FEC_HEADER);
+    exit(EXIT_FAILURE);
+  }
+  if (msgsize == 0)
+    msgsize = mtu;
+  if (msgsize < 1) {
+    fprintf(stderr, "%s: message size must be positive\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (batchsize < 1 || batchsize > MAXBATCH) {
+    fprintf(stderr, "%s: batch size must be between 1 and %d\n", argv[0], MAXBATCH);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("-----  UDP Loopback Network Backend Version 1.1 -------- \n\n");
+  printf("Enter the number of messages to simulate: ");
+  scanf("%d",&nsimmax);
+  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+  scanf("%f",&lossprob);
+  printf("Enter packet corruption probability [0.0 for no corruption]:");
+  scanf("%f",&corruptprob);
+  if (lossprob != 0.0 || corruptprob != 0.0) {
+    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
+    scanf("%d",&corruptdirection);
+  }
+  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+  scanf("%f",&lambda);
+  printf("Enter TRACE:");
+  scanf("%d",&TRACE);
+  if (traffic_init(arrivals, lambda, 9999) < 0) {
+    fprintf(stderr, "%s: bad arrival process '%s' (uniform, poisson, onoff[:alpha[:on[:off]]] or trace:file)\n", argv[0], arrivals);
+    exit(EXIT_FAILURE);
+  }
+
+  srand(9999);              /* init random number generator */
+  sum = 0.0;
+  for (i=0; i<1000; i++)
+    sum+=jimsrand();
+  avg = sum/1000.0;
+  if (avg < 0.25 || avg > 0.75) {
+    printf("It is likely that random number generation on your machine\n" );
+    printf("is different from what this backend expects.  Please take\n");
+    printf("a look at the routine jimsrand() in the backend code. Sorry. \n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* initialise statistics */
+  window_full = 0;
+  total_ACKs_received = 0;
+  packets_resent = 0;
+  new_ACKs = 0;
+  packets_received = 0;
+  naks_sent = 0;
+  nak_resends = 0;
+  messages_delivered = 0;
+  bytes_delivered = 0;
+  ntolayer3 = 0;
+  nlost = 0;
+  ncorrupt = 0;
+  nkernel = 0;
+  nfromlayer3 = 0;
+  txcount[A] = txcount[B] = 0;
+  sendcalls = sendpkts = sendmaxbatch = 0;
+  recvcalls = recvpkts = recvmaxbatch = 0;
+  latsum = 0;
+  latmin = INT64_MAX;
+  latmax = 0;
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0)
+    fatal("epoll_create1");
+  opensockets();
+  for (i=0; i<2; i++) {
+    timerfd[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd[i] < 0)
+      fatal("timerfd_create");
+    timeron[i] = OFF;
+  }
+  genfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (genfd < 0)
+    fatal("timerfd_create");
+  watch(sock[A], SOCKET_A);
+  watch(sock[B], SOCKET_B);
+  watch(timerfd[A], TIMER_A);
+  watch(timerfd[B], TIMER_B);
+  watch(genfd, GENERATOR);
+
+  starttime = now();
+  generating = (nsimmax > 0);
+  if (generating)
+    generate_next_arrival();
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+double get_sim_time(void)
+{
+  return unitsnow();
+}
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB)
+{
+  if (TRACE>1)
+    printf("          STOP TIMER: stopping timer at %f\n",unitsnow());
+  if (timeron[AorB] == OFF) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  armtimer(timerfd[AorB], 0.0, ON);
+  timeron[AorB] = OFF;
+}
+
+void starttimer(int AorB, double increment)
+{
+  if (TRACE>1)
+    printf("          START TIMER: starting timer at %f\n",unitsnow());
+  if (timeron[AorB] == ON) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  armtimer(timerfd[AorB], increment, OFF);
+  timeron[AorB] = ON;
+}
+
+/* hand AorB's queued packets to the kernel with as few sendmmsg() calls
+   as the batch size allows */
+static void flushlayer3(int AorB)
+{
+  struct mmsghdr hdr[MAXBATCH];
+  struct iovec iov[3*MAXBATCH];
+  unsigned char wire[MAXBATCH][PKTHEADERBYTES];
+  struct pkt *p;
+  int sent, n, i;
+
+  for (sent = 0; sent < txcount[AorB]; sent += n) {
+    n = txcount[AorB] - sent;
+    if (n > batchsize)
+      n = batchsize;
+    memset(hdr, 0, n * sizeof(hdr[0]));
+    for (i=0; i<n; i++) {
+      p = txpkt[AorB][sent+i];
+      pkt_pack(p, wire[i]);
+      iov[3*i].iov_base = &txtime[AorB][sent+i];
+      iov[3*i].iov_len = sizeof(int64_t);
+      iov[3*i+1].iov_base = wire[i];
+      iov[3*i+1].iov_len = PKTHEADERBYTES;
+      iov[3*i+2].iov_base = p->payload;
+      iov[3*i+2].iov_len = p->length;
+      hdr[i].msg_hdr.msg_iov = &iov[3*i];
+      hdr[i].msg_hdr.msg_iovlen = 3;
+    }
+    sendcalls++;
+    i = sendmmsg(sock[AorB], hdr, n, 0);
+    if (i < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+        fatal("sendmmsg");
+      i = 0;
+    }
+    sendpkts += i;
+    if (i > sendmaxbatch)
+      sendmaxbatch = i;
+    if (i < n) {
+      /* socket buffer full: the kernel sent none of the batch from
+         the first refused packet on.  That packet is dropped here on
+         purpose, as a full interface queue would drop it, and the
+         protocol's timer recovers it; the rest of the batch is retried */
+      nkernel++;
+      if (TRACE>0)
+        printf("          TOLAYER3: packet dropped, socket buffer full\n");
+      n = i + 1;
+    }
+  }
+  for (i=0; i<txcount[AorB]; i++)
+    releasepkt(txpkt[AorB][i]);
+  txcount[AorB] = 0;
+}
+
+/************************** TOLAYER3 ***************/
+void tolayer3(int AorB, struct pkt *packet)
+{
+  struct pkt *mypktptr;
+  double x;
+  int i;
+
+  ntolayer3++;
+
+  /* FEC parity packets carry a small header on top of the MTU */
+  if (packet->length < 0 || packet->length > mtu + (fec_block > 0 ? FEC_HEADER : 0)) {
+    printf("TOLAYER3: packet length %d is outside 0..%d (the MTU)\n", packet->length, mtu);
+    exit(EXIT_FAILURE);
+  }
+
+  /* simulate losses: */
+  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    nlost++;
+    if (TRACE>0)
+      printf("          TOLAYER3: packet being lost\n");
+    return;
+  }
+
+  mypktptr = holdpkt(packet);
+  if (TRACE>2)  {
+    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", packet->seqnum,
+           packet->acknum, packet->checksum);
+    for (i=0; i<packet->length; i++)
+      printf("%c",packet->payload[i]);
+    printf("\n");
+  }
+
+  /* simulate corruption: */
+  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    ncorrupt++;
+    /* copy on write: the sender still holds the original */
+    mypktptr = copypkt(packet);
+    releasepkt(packet);
+    if ( (x = jimsrand()) < .75) {
+      if (mypktptr->length > 0)
+        mypktptr->payload[0]='Z';   /* corrupt payload */
+      else
+        mypktptr->acknum = 999999;  /* no payload (an ACK): hit the header */
+    }
+    else if (x < .875)
+      mypktptr->seqnum = 999999;
+    else
+      mypktptr->acknum = 999999;
+    if (TRACE>0)
+      printf("          TOLAYER3: packet being corrupted\n");
+  }
+
+  if (txcount[AorB] == batchsize)
+    flushlayer3(AorB);
+  txpkt[AorB][txcount[AorB]] = mypktptr;
+  txtime[AorB][txcount[AorB]] = now();
+  txcount[AorB]++;
+}
+
+void tolayer5(int AorB, char datasent[], int length)
+{
+  int i;
+  if (TRACE>2) {
+    printf("          TOLAYER5: data received by application at ");
+    if (AorB == A)
+      printf("A: ");
+    else
+      printf("B: ");
+    for (i=0; i<length; i++)
+      printf("%c",datasent[i]);
+    printf("\n");
+  }
+  messages_delivered++;
+  bytes_delivered += length;
+}
+
+/* drain every datagram queued on AorB's socket into the protocol.  The
+   kernel writes straight into packet buffers, which are handed to the
+   protocol and recycled once it lets go of them. */
+static void fromlayer3(int AorB)
+{
+  static struct pkt *rxpkt[MAXBATCH];
+  static int64_t rxtime[MAXBATCH];
+  static unsigned char rxwire[MAXBATCH][PKTHEADERBYTES];
+  struct mmsghdr hdr[MAXBATCH];
+  struct iovec iov[3*MAXBATCH];
+  int64_t lat, t;
+  int n, i;
+
+  for (;;) {
+    memset(hdr, 0, batchsize * sizeof(hdr[0]));
+    for (i=0; i<batchsize; i++) {
+      if (rxpkt[i] == NULL)
+        rxpkt[i] = allocpkt();
+      iov[3*i].iov_base = &rxtime[i];
+      iov[3*i].iov_len = sizeof(int64_t);
+      iov[3*i+1].iov_base = rxwire[i];
+      iov[3*i+1].iov_len = PKTHEADERBYTES;
+      iov[3*i+2].iov_base = rxpkt[i]->payload;
+      iov[3*i+2].iov_len = MAXPAYLOAD;
+      hdr[i].msg_hdr.msg_iov = &iov[3*i];
+      hdr[i].msg_hdr.msg_iovlen = 3;
+    }
+    recvcalls++;
+    n = recvmmsg(sock[AorB], hdr, batchsize, 0, NULL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      if (errno == EINTR)
+        continue;
+      fatal("recvmmsg");
+    }
+    recvpkts += n;
+    if (n > recvmaxbatch)
+      recvmaxbatch = n;
+    t = now();
+    for (i=0; i<n; i++) {
+      if (hdr[i].msg_len < WIREHEADER)
+        continue;             /* not one of ours, reuse the buffer */
+      pkt_unpack(rxwire[i], rxpkt[i]);
+      if (hdr[i].msg_len != WIREHEADER + rxpkt[i]->length)
+        continue;
+      lat = t - rxtime[i];
+      latsum += lat;
+      if (lat < latmin)
+        latmin = lat;
+      if (lat > latmax)
+        latmax = lat;
+      nfromlayer3++;
+      if (TRACE>=2)
+        printf("\nEVENT time: %f,  type: 2, fromlayer3  entity: %d\n",unitsnow(),AorB);
+      if (AorB == A)
+        A_input(rxpkt[i]);
+      else
+        B_input(rxpkt[i]);
+      releasepkt(rxpkt[i]);
+      rxpkt[i] = NULL;
+    }
+    if (n < batchsize)
+      return;                 /* socket is drained */
+  }
+}
+
+/* consume a timerfd expiry; returns 0 if it was a stale wakeup */
+static int expired(int fd)
+{
+  uint64_t ticks;
+
+  if (read(fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+    return 0;
+  return 1;
+}
+
+static void fromlayer5(void)
+{
+  struct msg msg2give;
+  int i, j, sent;
+
+  if (TRACE>=2)
+    printf("\nEVENT time: %f,  type: 1, fromlayer5  entity: %d\n",unitsnow(),A);
+  generate_next_arrival();   /* set up future arrival */
+  j = nsim % 26;
+  for (i=0; i<mtu; i++)
+    msg2give.data[i] = 97 + j;
+  nsim++;
+  if (nsim == nsimmax) {
+    generating = OFF;
+    armtimer(genfd, 0.0, ON);
+  }
+  /* segment the application message into MTU sized pieces */
+  for (sent=0; sent<msgsize; sent+=msg2give.length) {
+    msg2give.length = (msgsize - sent < mtu) ? msgsize - sent : mtu;
+    if (TRACE>2) {
+      printf("          MAINLOOP: data given to student: ");
+      for (i=0; i<msg2give.length; i++)
+        printf("%c", msg2give.data[i]);
+      printf("\n");
+    }
+    A_output(&msg2give);
+  }
+}
+
+static void timerinterrupt(int AorB)
+{
+  if (TRACE>=2)
+    printf("\nEVENT time: %f,  type: 0, timerinterrupt  entity: %d\n",unitsnow(),AorB);
+  timeron[AorB] = OFF;
+  if (AorB == A)
+    A_timerinterrupt();
+  else
+    B_timerinterrupt();
+}
+
+int main(int argc, char **argv)
+{
+  struct epoll_event events[16];
+  int idlems;
+  int64_t elapsed;
+  double secs;
+  int n, i;
+
+  init(argc, argv);
+  A_init();
+  B_init();
+
+  /* with nothing left to generate and no timer running, the run is over
+     once the sockets have stayed quiet for longer than any packet can
+     reasonably take to cross loopback */
+  idlems = (int)(20 * unitns / 1000000.0);
+  if (idlems < 50)
+    idlems = 50;
+
+  for (;;) {
+    n = epoll_wait(epfd, events, 16,
+                   (generating || timeron[A] || timeron[B]) ? -1 : idlems);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fatal("epoll_wait");
+    }
+    if (n == 0)
+      break;
+    for (i=0; i<n; i++) {
+      switch (events[i].data.u32) {
+      case SOCKET_A:
+        fromlayer3(A);
+        break;
+      case SOCKET_B:
+        fromlayer3(B);
+        break;
+      case TIMER_A:
+        if (expired(timerfd[A]) && timeron[A])
+          timerinterrupt(A);
+        break;
+      case TIMER_B:
+        if (expired(timerfd[B]) && timeron[B])
+          timerinterrupt(B);
+        break;
+      case GENERATOR:
+        if (expired(genfd) && generating)
+          fromlayer5();
+        break;
+      }
+    }
+    /* end of tick: send everything the handlers queued */
+    flushlayer3(A);
+    flushlayer3(B);
+  }
+
+  elapsed = now() - starttime - (int64_t)idlems * 1000000;
+  secs = elapsed / 1e9;
+  printf(" Backend terminated at time %f\n after attempting to send %d msgs from layer5\n",elapsed/unitns,nsim);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
+  printf("number of packet resends by A:  %d \n", packets_resent);
+  printf("number of correct packets received at B:  %d \n", packets_received);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  printf("number of bytes delivered to application:  %ld \n", bytes_delivered);
+  if (use_naks)
+    printf("number of NAKs sent by B:  %d, packet resends caused by NAKs:  %d (the other %d after timeouts) \n",
+           naks_sent, nak_resends, packets_resent - nak_resends);
+  fec_report();
+  cwnd_report();
+  printf("checksum:  %s (%s) \n", cksum_algorithm(), cksum_implementation());
+  printf("arrivals:  %s \n", traffic_name());
+  printf("\n--- UDP loopback measurements (1 time unit = %.1f usec) ---\n", unitns/1000.0);
+  printf("packets passed to layer 3:  %d (lost %d, corrupted %d, dropped at full socket buffer %d)\n",
+         ntolayer3, nlost, ncorrupt, nkernel);
+  printf("packets received from layer 3:  %d \n", nfromlayer3);
+  printf("wall clock time:  %.6f s \n", secs);
+  if (secs > 0.0) {
+    printf("packets/sec:  sent %.0f  received %.0f \n", ntolayer3/secs, nfromlayer3/secs);
+    printf("goodput:  %.0f bytes/sec \n", bytes_delivered/secs);
+  }
+  if (nfromlayer3 > 0)
+    printf("one way latency:  mean %.2f usec  min %.2f usec  max %.2f usec  (mean %.4f time units, simulator draws 1..10)\n",
+           latsum/1000.0/nfromlayer3, latmin/1000.0, latmax/1000.0,
+           latsum/unitns/nfromlayer3);
+  printf("sendmmsg:  %ld calls, %ld packets, batch mean %.2f max %ld, syscalls/packet %.3f \n",
+         sendcalls, sendpkts, sendcalls ? (double)sendpkts/sendcalls : 0.0,
+         sendmaxbatch, sendpkts ? (double)sendcalls/sendpkts : 0.0);
+  printf("recvmmsg:  %ld calls, %ld packets, batch mean %.2f max %ld, syscalls/packet %.3f \n",
+         recvcalls, recvpkts, recvcalls ? (double)recvpkts/recvcalls : 0.0,
+         recvmaxbatch, recvpkts ? (double)recvcalls/recvpkts : 0.0);
+  return EXIT_SUCCESS;
+}